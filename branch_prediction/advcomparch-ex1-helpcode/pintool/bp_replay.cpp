@@ -0,0 +1,361 @@
+/**
+ * bp_replay: feeds a branch trace recorded by cslab_branch_trace through the
+ * predictors of cslab_branch without Pin. The output has the same format as
+ * cslab_branch.out, so the existing plotting scripts work on it unchanged.
+ *
+ * Build with: make -f makefile.replay
+ **/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <string>
+
+/* ===================================================================== */
+/* Pin types used by the predictor headers                               */
+/* ===================================================================== */
+typedef uint64_t ADDRINT;
+typedef uint64_t UINT64;
+typedef uint32_t UINT32;
+typedef uint16_t UINT16;
+typedef uint8_t UINT8;
+typedef int64_t INT64;
+typedef int32_t INT32;
+typedef int8_t INT8;
+typedef bool BOOL;
+typedef void VOID;
+
+using namespace std;
+
+#include "branch_sim.h"
+#include "predictor_spec.h"
+#include "branch_trace_reader.h"
+#include "interval_stats.h"
+#include "sampling.h"
+#include "predictor_snapshot.h"
+#include "timing_model.h"
+#include "storage_report.h"
+
+#define REPLAY_BATCH_RECORDS 16384
+
+/* ===================================================================== */
+
+static VOID FlushBatch(std::vector<BranchRecord> &batch, BranchCountSketch *sketch,
+                       std::vector<BranchPredictor *> &branch_predictors,
+                       std::vector<BTBPredictor *> &btb_predictors,
+                       std::vector<RASGroup *> &ras_vec,
+                       std::vector<IndirectPredictor *> &indirect_predictors)
+{
+    if (batch.empty())
+        return;
+    if (sketch)
+        sketch->addBatch(&batch[0], batch.size());
+    SimulateBatch(branch_predictors, btb_predictors, ras_vec, indirect_predictors,
+                  &batch[0], batch.size());
+    batch.clear();
+}
+
+static bool SaveSnapshot(const char *path, std::vector<BranchPredictor *> &branch_predictors,
+                         std::vector<BTBPredictor *> &btb_predictors,
+                         std::vector<RASGroup *> &ras_vec,
+                         std::vector<IndirectPredictor *> &indirect_predictors,
+                         UINT64 icount, UINT64 instructions)
+{
+    PredictorSnapshot snapshot;
+    string error;
+
+    snapshot.capture(branch_predictors, btb_predictors, ras_vec, indirect_predictors,
+                     icount, instructions);
+    if (!snapshot.write(path, error)) {
+        cerr << "Cannot save the predictor state: " << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+static int Usage(const char *prog)
+{
+    cerr << "Usage: " << prog << " [-o output] [-s start] [-e end] [-p] [-b] [-r] [-i] [-w repair]\n"
+         << "       [-S spec] [-F spec_file] [-P entries] [-I interval]\n"
+         << "       [-c interval_file] [-m ffwd,warmup,detail] [-x simpoints]\n"
+         << "       [-l snapshot [-u]] [-k snapshot] [-K checkpoint] [-T timing] [-B] trace_file\n\n"
+         << "Replays a branch trace through the branch predictors.\n"
+         << "  -o  output file (default: standard output)\n"
+         << "  -s  start replaying at this instruction count\n"
+         << "  -e  stop replaying at this instruction count\n"
+         << "  -p  simulate the conditional branch predictors\n"
+         << "  -b  simulate the BTBs\n"
+         << "  -r  simulate the RAS\n"
+         << "  -i  simulate the indirect target predictors\n"
+         << "  -w  RAS wrong path model: off, none, tos or tos+top[:rets,calls]\n"
+         << "  -S  also simulate the predictors of a spec (see predictor_spec.h)\n"
+         << "  -F  also simulate the predictors of the specs in a file\n"
+         << "  -P  list the most mispredicted branches of every predictor\n"
+         << "  -I  write the counters of every interval of this many instructions\n"
+         << "  -c  time series output file (default: bp_replay.intervals.csv)\n"
+         << "  -m  sampled simulation, instructions of the phases of every window\n"
+         << "  -x  start the windows of -m at the offsets of a simulation point file\n"
+         << "  -l  warm up the predictors with the state of a snapshot\n"
+         << "  -u  resume the run of the -l snapshot: restore the counters too and, without\n"
+         << "      -s, start at the instruction count the snapshot was taken at\n"
+         << "  -k  save the state of the predictors to a snapshot at the end\n"
+         << "  -K  also save the -k snapshot every this many instructions\n"
+         << "  -T  report cycles and IPC, given cpi,direction,btb,ras[,indirect] (the base\n"
+         << "      CPI and the miss penalties in cycles, see timing_model.h)\n"
+         << "  -B  report the storage in bits of every predictor and the MPKI-vs-storage\n"
+         << "      Pareto frontier, see storage_report.h\n"
+         << "Without any of -p/-b/-r/-i/-S/-F all the default predictors are simulated.\n";
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<BranchPredictor *> branch_predictors;
+    std::vector<BTBPredictor *> btb_predictors;
+    std::vector<RASGroup *> ras_vec;
+    std::vector<IndirectPredictor *> indirect_predictors;
+    std::vector<BranchRecord> batch;
+    bool do_preds = false, do_btbs = false, do_ras = false, do_indirect = false;
+    RASRepair ras_repair = RAS_NO_WRONG_PATH;
+    UINT32 wrong_path_rets = 1, wrong_path_calls = 1, profile_entries = 0;
+    BranchCountSketch *sketch = NULL;
+    UINT64 interval_length = 0;
+    const char *interval_path = "bp_replay.intervals.csv";
+    IntervalStats *interval_stats = NULL;
+    std::ofstream intervalFile;
+    UINT64 ffwd = 0, warmup = 0, detail = 0, detail_start = 0;
+    const char *simpoints_path = NULL;
+    SampleSchedule *sample_schedule = NULL;
+    SampleStats *sample_stats = NULL;
+    TimingModel *timing_model = NULL;
+    const char *load_path = NULL, *save_path = NULL;
+    bool resume = false, start_given = false, do_storage = false;
+    UINT64 checkpoint_interval = 0, next_checkpoint = ~0ULL, resumed_instructions = 0;
+    const char *out_path = NULL;
+    UINT64 start_icount = 0, end_icount = ~0ULL, total_instructions;
+    BranchTraceReader reader;
+    BranchTraceReader::iterator it;
+    std::ofstream outFile;
+    string specs, error;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:s:e:pbriw:S:F:P:I:c:m:x:l:uk:K:T:B")) != -1) {
+        switch (opt) {
+        case 'o': out_path = optarg; break;
+        case 's': start_icount = strtoull(optarg, NULL, 0); start_given = true; break;
+        case 'e': end_icount = strtoull(optarg, NULL, 0); break;
+        case 'p': do_preds = true; break;
+        case 'b': do_btbs = true; break;
+        case 'r': do_ras = true; break;
+        case 'i': do_indirect = true; break;
+        case 'w':
+            if (!ParseRASRepair(optarg, ras_repair, wrong_path_rets, wrong_path_calls))
+                return Usage(argv[0]);
+            break;
+        case 'S':
+            specs += string(optarg) + "\n";
+            break;
+        case 'F':
+            if (!ReadPredictorSpecFile(optarg, specs)) {
+                cerr << "Cannot read spec file " << optarg << "\n";
+                return -1;
+            }
+            break;
+        case 'P': profile_entries = strtoul(optarg, NULL, 0); break;
+        case 'I': interval_length = strtoull(optarg, NULL, 0); break;
+        case 'c': interval_path = optarg; break;
+        case 'm':
+            if (sscanf(optarg, "%llu,%llu,%llu", (unsigned long long *)&ffwd,
+                       (unsigned long long *)&warmup, (unsigned long long *)&detail) != 3
+                || detail == 0)
+                return Usage(argv[0]);
+            break;
+        case 'x': simpoints_path = optarg; break;
+        case 'l': load_path = optarg; break;
+        case 'u': resume = true; break;
+        case 'k': save_path = optarg; break;
+        case 'K': checkpoint_interval = strtoull(optarg, NULL, 0); break;
+        case 'T':
+            timing_model = new TimingModel();
+            if (!timing_model->parse(optarg))
+                return Usage(argv[0]);
+            break;
+        case 'B': do_storage = true; break;
+        default: return Usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || (resume && !load_path) || (checkpoint_interval && !save_path))
+        return Usage(argv[0]);
+
+    if (!do_preds && !do_btbs && !do_ras && !do_indirect && specs.empty())
+        do_preds = do_btbs = do_ras = do_indirect = true;
+
+    if (!reader.open(argv[optind])) {
+        cerr << "Cannot read branch trace " << argv[optind] << ": " << reader.getError() << "\n";
+        return -1;
+    }
+
+    if (do_preds)
+        InitPredictors(branch_predictors);
+    if (do_btbs)
+        BTB(btb_predictors);
+    if (do_ras)
+        InitRas(ras_vec);
+    if (do_indirect)
+        InitIndirectPredictors(indirect_predictors);
+    if (!BuildPredictorsFromSpecs(specs, branch_predictors, btb_predictors, ras_vec,
+                                  indirect_predictors, error)) {
+        cerr << "Bad predictor spec: " << error << "\n";
+        return -1;
+    }
+    for (UINT32 i = 0; i < ras_vec.size(); i++)
+        ras_vec[i]->setRepair(ras_repair, wrong_path_rets, wrong_path_calls);
+    if (load_path) {
+        PredictorSnapshot snapshot;
+        UINT32 num_restored;
+        if (!snapshot.read(load_path, error)
+            || !snapshot.restore(branch_predictors, btb_predictors, ras_vec, indirect_predictors,
+                                 resume, num_restored, error)) {
+            cerr << "Cannot load the predictor state: " << error << "\n";
+            return -1;
+        }
+        cerr << "Loaded the state of " << num_restored << " predictors from " << load_path << "\n";
+        if (resume) {
+            if (!start_given)
+                start_icount = snapshot.getICount();
+            resumed_instructions = snapshot.getInstructions();
+        }
+    }
+    if (checkpoint_interval > 0)
+        next_checkpoint = start_icount + checkpoint_interval;
+    if (profile_entries > 0) {
+        InitProfiles(branch_predictors, profile_entries);
+        sketch = new BranchCountSketch();
+    }
+    if (detail > 0) {
+        if (!simpoints_path) {
+            sample_schedule = new SampleSchedule(ffwd, warmup, detail);
+        } else {
+            sample_schedule = new SampleSchedule(warmup, detail);
+            if (!sample_schedule->readPoints(simpoints_path, error)) {
+                cerr << "Bad simulation points: " << error << "\n";
+                return -1;
+            }
+        }
+        sample_stats = new SampleStats();
+        sample_stats->start(branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+    }
+    if (interval_length > 0) {
+        intervalFile.open(interval_path);
+        interval_stats = new IntervalStats(intervalFile, interval_length, start_icount);
+        interval_stats->start(branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+    }
+
+    // Batches go through SimulateBatch(), as the buffers of cslab_branch
+    for (it = reader.seek(start_icount); it != reader.end(); ++it) {
+        const BranchRecord &rec = *it;
+
+        if (rec.icount >= end_icount)
+            break;
+
+        // The trace has the instruction count of every branch, so the
+        // intervals end exactly on their boundaries here
+        if (interval_stats && rec.icount >= interval_stats->getNextBoundary()) {
+            FlushBatch(batch, sketch, branch_predictors, btb_predictors, ras_vec,
+                       indirect_predictors);
+            interval_stats->sample(interval_stats->getNextBoundary());
+        }
+
+        // Same phases as the sampling of cslab_branch, on the exact boundaries
+        if (sample_schedule) {
+            if (rec.icount >= sample_schedule->getNextSwitch())
+                FlushBatch(batch, sketch, branch_predictors, btb_predictors, ras_vec,
+                           indirect_predictors);
+            while (rec.icount >= sample_schedule->getNextSwitch()) {
+                UINT64 boundary = sample_schedule->getNextSwitch();
+                UINT32 window = WindowOfEpoch(sample_schedule->getEpoch());
+                if (sample_schedule->getPhase() == SAMPLE_DETAIL)
+                    sample_stats->endWindow(boundary - detail_start,
+                                            sample_schedule->getWeight(window));
+                sample_schedule->advance(boundary);
+                if (sample_schedule->getPhase() == SAMPLE_DETAIL) {
+                    detail_start = boundary;
+                    sample_stats->beginWindow();
+                }
+            }
+            if (sample_schedule->getPhase() == SAMPLE_FFWD)
+                continue;
+        }
+
+        // Checkpoints are taken on the exact instruction counts too
+        if (rec.icount >= next_checkpoint) {
+            FlushBatch(batch, sketch, branch_predictors, btb_predictors, ras_vec,
+                       indirect_predictors);
+            while (rec.icount >= next_checkpoint)
+                next_checkpoint += checkpoint_interval;
+            UINT64 icount = next_checkpoint - checkpoint_interval;
+            if (!SaveSnapshot(save_path, branch_predictors, btb_predictors, ras_vec,
+                              indirect_predictors, icount,
+                              icount - start_icount + resumed_instructions))
+                return -1;
+        }
+
+        batch.push_back(rec);
+        if (batch.size() == REPLAY_BATCH_RECORDS)
+            FlushBatch(batch, sketch, branch_predictors, btb_predictors, ras_vec,
+                       indirect_predictors);
+    }
+    FlushBatch(batch, sketch, branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+
+    // Instructions of the replayed window
+    total_instructions = reader.getTotalInstructions();
+    if (end_icount < total_instructions)
+        total_instructions = end_icount;
+    if (interval_stats) {
+        interval_stats->finish(total_instructions);
+        intervalFile.close();
+    }
+    if (sample_schedule && sample_schedule->getPhase() == SAMPLE_DETAIL
+        && total_instructions > detail_start)
+        sample_stats->endWindow(total_instructions - detail_start,
+                                sample_schedule->getWeight(WindowOfEpoch(sample_schedule->getEpoch())));
+    if (save_path
+        && !SaveSnapshot(save_path, branch_predictors, btb_predictors, ras_vec, indirect_predictors,
+                         total_instructions, std::max(total_instructions, start_icount)
+                                             - start_icount + resumed_instructions))
+        return -1;
+    total_instructions = total_instructions > start_icount ? total_instructions - start_icount : 0;
+    total_instructions += resumed_instructions;
+
+    if (out_path)
+        outFile.open(out_path);
+    std::ostream &out = out_path ? outFile : cout;
+
+    PrintStats(out, total_instructions,
+               branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+    if (timing_model) {
+        out << "\n";
+        timing_model->print(out, total_instructions,
+                            branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+    }
+    if (do_storage) {
+        out << "\n";
+        PrintStorage(out, total_instructions,
+                     branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+    }
+    // No symbols in a trace, the PCs are printed alone
+    if (sketch) {
+        out << "\n";
+        PrintProfiles(out, branch_predictors, *sketch, NULL);
+    }
+    if (sample_stats) {
+        out << "\n";
+        sample_stats->print(out, sample_schedule->isPeriodic());
+    }
+
+    return 0;
+}
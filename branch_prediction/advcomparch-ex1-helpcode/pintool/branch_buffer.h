@@ -0,0 +1,64 @@
+#ifndef BRANCH_BUFFER_H
+#define BRANCH_BUFFER_H
+
+/**
+ * Records the branches of the application as BranchRecords into a per-thread
+ * Pin trace buffer. The inlined fill code replaces one analysis call per
+ * branch; the tool processes the records in bulk when a buffer fills up.
+ **/
+
+#include <cstddef>
+
+#include "branch_trace.h"
+
+#define BRANCH_BUFFER_PAGE_SIZE 4096
+
+static inline BUFFER_ID DefineBranchBuffer(UINT32 num_records, TRACE_BUFFER_CALLBACK fun)
+{
+    UINT32 num_pages = (num_records * sizeof(BranchRecord) + BRANCH_BUFFER_PAGE_SIZE - 1)
+                       / BRANCH_BUFFER_PAGE_SIZE;
+
+    return PIN_DefineTraceBuffer(sizeof(BranchRecord), num_pages, fun, 0);
+}
+
+/**
+ * Same classification as the original analysis calls of cslab_branch:
+ * conditional branches, calls, returns and any other branch, with indirect
+ * calls and jumps told apart from direct ones. A non-zero epoch is stored in
+ * the records, otherwise the field is left alone.
+ **/
+static inline VOID InstrumentBranch(INS ins, BUFFER_ID buf_id, UINT32 epoch = 0)
+{
+    UINT32 kind;
+
+    if (INS_Category(ins) == XED_CATEGORY_COND_BR)
+        kind = BRANCH_COND;
+    else if (INS_IsCall(ins))
+        kind = INS_IsIndirectControlFlow(ins) ? BRANCH_IND_CALL : BRANCH_CALL;
+    else if (INS_IsRet(ins))
+        kind = BRANCH_RET;
+    else if (INS_IsBranch(ins))
+        kind = INS_IsIndirectControlFlow(ins) ? BRANCH_IND_JUMP : BRANCH_JUMP;
+    else
+        return;
+
+    if (epoch)
+        INS_InsertFillBuffer(ins, IPOINT_BEFORE, buf_id,
+                             IARG_INST_PTR, offsetof(BranchRecord, ip),
+                             IARG_BRANCH_TARGET_ADDR, offsetof(BranchRecord, target),
+                             IARG_BRANCH_TAKEN, offsetof(BranchRecord, taken),
+                             IARG_UINT32, kind, offsetof(BranchRecord, kind),
+                             IARG_UINT32, INS_Size(ins), offsetof(BranchRecord, size),
+                             IARG_UINT32, epoch, offsetof(BranchRecord, epoch),
+                             IARG_END);
+    else
+        INS_InsertFillBuffer(ins, IPOINT_BEFORE, buf_id,
+                             IARG_INST_PTR, offsetof(BranchRecord, ip),
+                             IARG_BRANCH_TARGET_ADDR, offsetof(BranchRecord, target),
+                             IARG_BRANCH_TAKEN, offsetof(BranchRecord, taken),
+                             IARG_UINT32, kind, offsetof(BranchRecord, kind),
+                             IARG_UINT32, INS_Size(ins), offsetof(BranchRecord, size),
+                             IARG_END);
+}
+
+#endif
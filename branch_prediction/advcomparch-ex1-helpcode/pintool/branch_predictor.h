@@ -5,8 +5,15 @@
 #include <cmath>   // pow(), floor
 #include <cstring> // memset()
 #include <vector>
-#include <list>
 #include <cstdint>
+#include <algorithm>
+
+#include "branch_trace.h"
+#include "branch_profile.h"
+#include "counter_table.h"
+#include "history_register.h"
+#include "perceptron_kernel.h"
+#include "state_archive.h"
 
 /**
  * A generic BranchPredictor base class.
@@ -16,18 +23,69 @@
 class BranchPredictor
 {
 public:
-    BranchPredictor() : correct_predictions(0), incorrect_predictions(0) {};
+    BranchPredictor() : correct_predictions(0), incorrect_predictions(0), profile(NULL) {};
     virtual ~BranchPredictor() {};
 
     virtual bool predict(ADDRINT ip, ADDRINT target) = 0;
     virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) = 0;
     virtual string getName() = 0;
 
+    //> Storage of the predictor in hardware, in bits: every table entry
+    //  (tags, valid bits, counters, targets, useful and replacement bits)
+    //  and every history register. Bookkeeping of the model that hardware
+    //  would not keep, like the statistics, is left out.
+    virtual UINT64 getStorageBits() = 0;
+
+    //> Predicts and trains on one branch. Predictors that can look up and
+    //  train with a single index computation override this.
+    virtual bool access(ADDRINT ip, ADDRINT target, bool actual) {
+        bool predicted = predict(ip, target);
+        update(predicted, actual, ip, target);
+        return predicted;
+    }
+
+    //> Runs the conditional branches of a batch through the predictor.
+    //  Overridden by EnginePredictor so that the whole loop is inlined.
+    virtual void accessBatch(const BranchRecord *batch, UINT32 num_records) {
+        for (UINT32 i = 0; i < num_records; i++) {
+            const BranchRecord &rec = batch[i];
+            if (rec.kind != BRANCH_COND)
+                continue;
+            bool predicted = access(rec.ip, rec.target, rec.taken);
+            if (profile)
+                profile->addPrediction(rec.ip, predicted != (bool)rec.taken);
+        }
+    }
+
     UINT64 getNumCorrectPredictions() { return correct_predictions; }
     UINT64 getNumIncorrectPredictions() { return incorrect_predictions; }
 
+    //> Mispredictions seen by accessBatch() are also recorded in profile
+    void setProfile(BranchProfile *profile_) { profile = profile_; }
+    BranchProfile *getProfile() { return profile; }
+
    void resetCounters() { correct_predictions = incorrect_predictions = 0; };
 
+    //> Adds the counters of another instance of the same predictor
+    virtual void mergeCounters(BranchPredictor *other) {
+        correct_predictions += other->correct_predictions;
+        incorrect_predictions += other->incorrect_predictions;
+    }
+
+    //> Mispredictions of the base predictor that an overlay predictor
+    //  (LoopOverlayPredictor) removed and added, false for the others
+    virtual bool getOverlayStats(UINT64 &removed, UINT64 &added) { return false; }
+
+    //> Tables and histories, see predictor_snapshot.h. The static
+    //  predictors have none.
+    virtual void serializeState(StateArchive &ar) {}
+
+    //> The prediction counters, only restored when a run is resumed
+    virtual void serializeCounters(StateArchive &ar) {
+        ar.io(correct_predictions);
+        ar.io(incorrect_predictions);
+    }
+
 protected:
     void updateCounters(bool predicted, bool actual) {
         if (predicted == actual)
@@ -39,6 +97,7 @@ protected:
 private:
     UINT64 correct_predictions;
     UINT64 incorrect_predictions;
+    BranchProfile *profile;
 };
 
 class AlwaysTakenPredictor : public BranchPredictor {
@@ -59,6 +118,8 @@ public:
 		stream << "Static AlwaysTaken";
 		return stream.str();
 	}
+
+	virtual UINT64 getStorageBits() { return 0; }
 };
 
 class BTFNTPredictor : public BranchPredictor {
@@ -79,89 +140,89 @@ public:
 		stream << "Static BTFNT";
 		return stream.str();
 	}
+
+	virtual UINT64 getStorageBits() { return 0; }
 };
 
 class NbitPredictor : public BranchPredictor
 {
 public:
     NbitPredictor(unsigned index_bits_, unsigned cntr_bits_, int type_ = 1)
-        : BranchPredictor(), index_bits(index_bits_), cntr_bits(cntr_bits_), type(type_) {
+        : BranchPredictor(), index_bits(index_bits_), cntr_bits(cntr_bits_),
+          TABLE(index_bits_, cntr_bits_), type(type_) {
         table_entries = 1 << index_bits;
-        TABLE = new unsigned long long[table_entries];
-        memset(TABLE, 0, table_entries * sizeof(*TABLE));
-        
+
 	// Enable different type only when cntr_bits == 2 (N=2)
 	if(cntr_bits != 2) type = 1;
 
         COUNTER_MAX = (1 << cntr_bits) - 1;
     };
-    ~NbitPredictor() { delete TABLE; };
+    ~NbitPredictor() { };
 
     virtual bool predict(ADDRINT ip, ADDRINT target) {
         unsigned int ip_table_index = ip % table_entries;
-        unsigned long long ip_table_value = TABLE[ip_table_index];
-        unsigned long long prediction = ip_table_value >> (cntr_bits - 1);
-        return (prediction != 0);
+        return TABLE.predict(ip_table_index);
     };
 
     virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
         unsigned int ip_table_index = ip % table_entries;
+
+        // The plain saturating counter is updated in place, the alternative
+        // FSMs go through the counter value
+        if (type == 1) {
+            TABLE.update(ip_table_index, actual);
+            updateCounters(predicted, actual);
+            return;
+        }
+
+        unsigned int state = TABLE.get(ip_table_index);
 	switch(type) {
-	case 1:
-		if (actual) {
-		    if (TABLE[ip_table_index] < COUNTER_MAX)
-			TABLE[ip_table_index]++;
-		} else {
-		    if (TABLE[ip_table_index] > 0)
-			TABLE[ip_table_index]--;
-		}
-		break;
 	case 2:
 		if(actual) {
 			// Normal up
-			if(TABLE[ip_table_index] < COUNTER_MAX)
-				TABLE[ip_table_index]++;
+			if(state < COUNTER_MAX)
+				state++;
 		} else {
 			// If state == 2 then go to state 0
-			if(TABLE[ip_table_index] == 2) {
-				TABLE[ip_table_index] = 0;
+			if(state == 2) {
+				state = 0;
 			} else { // for the other states normal down
-				if(TABLE[ip_table_index] > 0)
-					TABLE[ip_table_index]--;
+				if(state > 0)
+					state--;
 			}
 		}
 		break;
 	case 3:
 		if(actual) {
 			// If state == 1 then go to state 3
-			if(TABLE[ip_table_index] == 1) {
-				TABLE[ip_table_index] = 3;
+			if(state == 1) {
+				state = 3;
 			} else { // for the other states normal up
-				if(TABLE[ip_table_index] < COUNTER_MAX)
-					TABLE[ip_table_index]++;
+				if(state < COUNTER_MAX)
+					state++;
 			}
 		} else { // Normal down
-			if(TABLE[ip_table_index] > 0)
-				TABLE[ip_table_index]--;
+			if(state > 0)
+				state--;
 		}
 		break;
 	case 4:
 		if(actual) {
 			// If state == 1 then go to state 3
-			if(TABLE[ip_table_index] == 1) {
-				TABLE[ip_table_index] = 3;
+			if(state == 1) {
+				state = 3;
 			} else { // for the other states normal up
-				if(TABLE[ip_table_index] < COUNTER_MAX)
-					TABLE[ip_table_index]++;
+				if(state < COUNTER_MAX)
+					state++;
 			}
 			
 		} else {
 			// If state == 2 then go to state 0
-			if(TABLE[ip_table_index] == 2) {
-				TABLE[ip_table_index] = 0;
+			if(state == 2) {
+				state = 0;
 			} else { // for the other states normal down
-				if(TABLE[ip_table_index] > 0)
-					TABLE[ip_table_index]--;
+				if(state > 0)
+					state--;
 			}
 
 		}
@@ -169,23 +230,24 @@ public:
 	case 5:
 		if(actual) {
 			// If state == 1 then go to state 3
-			if(TABLE[ip_table_index] == 1) {
-				TABLE[ip_table_index] = 3;
-			} else if(TABLE[ip_table_index] == 3) { // if state == 3 then go to state 2
-				TABLE[ip_table_index] = 2;
+			if(state == 1) {
+				state = 3;
+			} else if(state == 3) { // if state == 3 then go to state 2
+				state = 2;
 			} else { // fot the other states normal up
-				if(TABLE[ip_table_index] < COUNTER_MAX)
-					TABLE[ip_table_index]++;
+				if(state < COUNTER_MAX)
+					state++;
 			}
 		} else {
 			// Normal down
-			if(TABLE[ip_table_index] > 0)
-				TABLE[ip_table_index]--;
+			if(state > 0)
+				state--;
 		}
 		break;
 	default:
 		std::cerr << "Unknown type of NBitPredictor! Valid types: 1,2,3,4,5.\n";
 	}
+        TABLE.set(ip_table_index, state);
         updateCounters(predicted, actual);
     };
 
@@ -197,86 +259,147 @@ public:
         return stream.str();
     }
 
+    virtual UINT64 getStorageBits() { return (UINT64)table_entries * cntr_bits; }
+
+    virtual void serializeState(StateArchive &ar) { TABLE.serialize(ar); }
+
 private:
     unsigned int index_bits, cntr_bits;
     unsigned int COUNTER_MAX;
     
-    /* Make this unsigned long long so as to support big numbers of cntr_bits. */
-    unsigned long long *TABLE;
+    /* Counters of 1 to 8 bits, packed into 64-bit words. */
+    PackedCounterTable<> TABLE;
     unsigned int table_entries;
 
     int type;
 };
 	
-class ShiftRegister {
-public:
-	ShiftRegister(std::uint16_t size) : data(0), size(size) { }
-
-	void shiftRight(bool in_bit) {
-		data = ((data >> 1) | (in_bit ? (1 << (size-1)) : 0)) & this->mask();
-	}
-
-	std::uint16_t getValue() const {
-		return data;
-	}
-
-private:
-	std::uint16_t data;
-	std::uint16_t size;
-
-	std::uint16_t mask() const {
-		// e.g. if size = 4 mask = 0b1111
-		return (1 << size) - 1;
-	}
+/**
+ * How GlobalHistoryPredictor combines the branch address and the global
+ * history into a PHT index of index_bits bits:
+ *   GHIST_CONCAT  - history:address, the original two level predictor
+ *   GHIST_GSELECT - address:history
+ *   GHIST_GSHARE  - address XOR history, at most the newest index_bits
+ *                   outcomes
+ *   GHIST_FOLDED  - address XOR the history folded to index_bits bits,
+ *                   for histories longer than the index
+ **/
+enum GlobalHistoryHash {
+	GHIST_CONCAT = 0,
+	GHIST_GSELECT,
+	GHIST_GSHARE,
+	GHIST_FOLDED
 };
 
 class GlobalHistoryPredictor : public BranchPredictor {
 public:
-	GlobalHistoryPredictor(int entries_bits, int nbit_length) {
-		this->pht_entries = 1 << entries_bits;
-		this->nbit_length = nbit_length;
-		this->BHR_MAX = (1 << nbit_length) - 1;
-		this->bhr = new ShiftRegister(nbit_length);
-		this->num_predictors = 1 << nbit_length;
-		for(int i = 0; i < this->num_predictors; i++)
-			this->predictors.push_back(new NbitPredictor(entries_bits, nbit_length));
+	// The original predictor: 2^entries_bits counters for every value of the
+	// history, nbit_length is both the history length and the counter width
+	GlobalHistoryPredictor(int entries_bits, int nbit_length)
+		: bhr(nbit_length), pht(entries_bits + nbit_length, nbit_length) {
+		this->init(entries_bits + nbit_length, nbit_length, nbit_length, GHIST_CONCAT);
 	}
 
-	~GlobalHistoryPredictor() {
-		delete this->bhr;
-
-		for(int i = 0; i < this->num_predictors; i++)
-			delete this->predictors[i];
+	// history_length must be at least 1, the specs check it (predictor_spec.h)
+	GlobalHistoryPredictor(int index_bits, int history_length, int cntr_bits, GlobalHistoryHash hash)
+		: bhr(history_length), pht(index_bits, cntr_bits) {
+		assert(history_length >= 1);
+		this->init(index_bits, history_length, cntr_bits, hash);
 	}
 
+	~GlobalHistoryPredictor() { }
+
 	virtual bool predict(ADDRINT ip, ADDRINT target) {
-		// select the predictor and predict
-		return this->predictors[this->bhr->getValue()]->predict(ip, target);	
+		return this->pht.predict(this->index(ip));
 	}
 
 	virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
-		// update the selected predictor
-		this->predictors[this->bhr->getValue()]->update(predicted, actual, ip, target);
+		// update the selected counter
+		this->pht.update(this->index(ip), actual);
 
 		// update the Branch History Register
-		this->bhr->shiftRight(actual);
-		
+		this->bhr.push(actual);
+
+		updateCounters(predicted, actual);
+	}
+
+	virtual bool access(ADDRINT ip, ADDRINT target, bool actual) {
+		unsigned int index = this->index(ip);
+		bool predicted = this->pht.predict(index);
+
+		this->pht.update(index, actual);
+		this->bhr.push(actual);
 		updateCounters(predicted, actual);
+		return predicted;
 	}
 
 	virtual string getName() {
+		static const char *hash_names[] = { "concat", "gselect", "gshare", "folded" };
 		std::ostringstream stream;
-		stream << "Global History Two Level Predictor (entries=" << this->pht_entries 
-		       << ", nbit=" << this->nbit_length << ")";
+
+		if (this->hash == GHIST_CONCAT && this->history_length == this->cntr_bits) {
+			stream << "Global History Two Level Predictor (entries=" << this->pht_entries
+			       << ", nbit=" << this->cntr_bits << ")";
+		} else {
+			stream << "Global History Predictor (" << hash_names[this->hash]
+			       << ", entries=" << (1 << this->index_bits)
+			       << ", history=" << this->history_length
+			       << ", nbit=" << this->cntr_bits << ")";
+		}
 		return stream.str();
 	}
 
+	virtual UINT64 getStorageBits() {
+		return (UINT64)this->pht.size() * this->cntr_bits + this->history_length;
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		this->bhr.serialize(ar);
+		this->pht.serialize(ar);
+	}
+
 private:
-	int pht_entries, nbit_length; // bhr_length = nbit_length
-	int num_predictors;
-	ShiftRegister* bhr;
-	int BHR_MAX;
-	std::vector< NbitPredictor* > predictors;
+	int index_bits, history_length, cntr_bits;
+	int pht_entries; // address part of the index for concat and gselect
+	GlobalHistoryHash hash;
+	HistoryRegister bhr;
+	unsigned int fold_id; // folded view of the whole history for GHIST_FOLDED
+	PackedCounterTable<> pht;
+
+	void init(int index_bits, int history_length, int cntr_bits, GlobalHistoryHash hash) {
+		this->index_bits = index_bits;
+		this->history_length = history_length;
+		this->cntr_bits = cntr_bits;
+		this->hash = hash;
+
+		// concat and gselect need room for the whole history in the index,
+		// gshare XORs the newest index_bits outcomes into it (the older ones
+		// would only reach the bits the mask drops); gfolded keeps them all
+		if (hash != GHIST_FOLDED && history_length > index_bits)
+			this->history_length = index_bits;
+		if (hash == GHIST_FOLDED)
+			this->fold_id = this->bhr.addFold(history_length, index_bits);
+		this->pht_entries = 1 << (index_bits - ((hash == GHIST_CONCAT || hash == GHIST_GSELECT)
+		                                        ? this->history_length : 0));
+	}
+
+	unsigned int index(ADDRINT ip) const {
+		unsigned int index_mask = (1u << this->index_bits) - 1;
+		UINT64 history = this->bhr.value(this->history_length < 64 ? this->history_length : 64);
+
+		switch (this->hash) {
+		case GHIST_CONCAT:
+			return ((unsigned int)history << (this->index_bits - this->history_length))
+			       | (ip % this->pht_entries);
+		case GHIST_GSELECT:
+			return ((ip % this->pht_entries) << this->history_length) | (unsigned int)history;
+		case GHIST_GSHARE:
+			return (ip ^ history) & index_mask;
+		case GHIST_FOLDED:
+		default:
+			return (ip ^ this->bhr.folded(this->fold_id)) & index_mask;
+		}
+	}
 };
 
 class LocalHistoryPredictor : public BranchPredictor {
@@ -290,36 +413,29 @@ public:
 		this->pht_length = pht_length;
 		pht = new NbitPredictor(pht_entry_bits, pht_length);
 		
-		for(int i = 0; i < this->bht_entries; i++)
-			this->bht.push_back(new ShiftRegister(bht_length));
+		// Histories longer than the PHT index are folded into it
+		this->bht.resize(this->bht_entries, HistoryRegister(bht_length));
+		if (bht_length > pht_entry_bits)
+			for(int i = 0; i < this->bht_entries; i++)
+				this->bht[i].addFold(bht_length, pht_entry_bits);
 	}
 
 	~LocalHistoryPredictor() {
 		delete pht;
-		
-		for(std::size_t i = 0; i < this->bht.size(); i++)
-			delete this->bht[i];
 	}
 
 	virtual bool predict(ADDRINT ip, ADDRINT target) {
-		std::uint16_t bht_index = ip & this->bht_mask();
-		std::uint16_t bht_value = this->bht[bht_index]->getValue(); // Z bits (bht_length)
-		
-		std::uint16_t pc_part = ip & this->pc_mask(); // pht_entry_bits - Z bits
-		std::uint16_t custom_ip = (pc_part << this->bht_length) | (bht_value); // pht_entry_bits bits
+		unsigned int bht_index = ip & this->bht_mask();
 
-		return this->pht->predict(custom_ip, target);		
+		return this->pht->predict(this->pht_index(ip, this->bht[bht_index]), target);
 	}
 
 	virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
-		std::uint16_t bht_index = ip & this->bht_mask();
-		std::uint16_t bht_value = this->bht[bht_index]->getValue(); // Z bits (bht_length)
-		
-		std::uint16_t pc_part = ip & this->pc_mask(); // pht_entry_bits - Z bits
-		std::uint16_t custom_ip = (pc_part << this->bht_length) | (bht_value); // pht_entry_bits bits
+		unsigned int bht_index = ip & this->bht_mask();
+		ADDRINT custom_ip = this->pht_index(ip, this->bht[bht_index]); // pht_entry_bits bits
 		
-		// update the correct ShiftRegister that we used for prediction
-		this->bht[bht_index]->shiftRight(actual);
+		// update the correct history register that we used for prediction
+		this->bht[bht_index].push(actual);
 
 		// update the pht with the correct ip
 		this->pht->update(predicted, actual, custom_ip, target);
@@ -333,27 +449,253 @@ public:
 		       << ", BHT length=" << this->bht_length << ")";
 		return stream.str();
 	}
+
+	virtual UINT64 getStorageBits() {
+		return (UINT64)this->bht_entries * this->bht_length + this->pht->getStorageBits();
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		this->pht->serializeState(ar);
+		for (int i = 0; i < this->bht_entries; i++)
+			this->bht[i].serialize(ar);
+	}
 private:
 	int bht_entry_bits, bht_entries, bht_length;
 	int pht_entry_bits, pht_length;
 	NbitPredictor* pht;
-	std::vector< ShiftRegister* > bht;
+	std::vector< HistoryRegister > bht;
 
 	// mask to get the last bht_entry_bits bits of the PC to index BHT
-	std::uint16_t bht_mask() const {
+	unsigned int bht_mask() const {
 		return (1 << bht_entry_bits) - 1;
 	}
 
-	std::uint16_t pc_mask() const {
+	unsigned int pc_mask() const {
 		return (1 << (pht_entry_bits-bht_length)) -1;
 	}
+
+	// the PC bits above the Z history bits (bht_length), or the history
+	// folded to pht_entry_bits bits when it does not fit
+	ADDRINT pht_index(ADDRINT ip, const HistoryRegister &history) const {
+		if (this->bht_length > this->pht_entry_bits)
+			return history.folded(0);
+
+		ADDRINT pc_part = ip & this->pc_mask(); // pht_entry_bits - Z bits
+		return (pc_part << this->bht_length) | history.value(this->bht_length);
+	}
+};
+
+/**
+ * Global perceptron predictor (Jimenez & Lin): 2^entries_bits perceptrons
+ * of history_length int8 weights plus a bias, selected by the address. The
+ * history can be of any length, it is kept as a +1/-1 vector so that the
+ * dot product and the training run in the SIMD kernels of
+ * perceptron_kernel.h.
+ **/
+class PerceptronPredictor : public BranchPredictor {
+public:
+	PerceptronPredictor(int entries_bits, int history_length) {
+		this->entries_bits = entries_bits;
+		this->history_length = history_length;
+		this->row_length = (history_length + PERCEPTRON_VECTOR_BYTES - 1)
+		                   / PERCEPTRON_VECTOR_BYTES * PERCEPTRON_VECTOR_BYTES;
+		this->theta = 193 * history_length / 100 + 14; // 1.93h + 14
+
+		this->weights.resize((size_t)this->row_length << entries_bits, 0);
+		this->bias.resize(1 << entries_bits, 0);
+		// the history window slides down a buffer twice its size and is
+		// copied back to the top when it reaches the start
+		this->history.resize(2 * this->row_length, 0);
+		this->history_pos = this->row_length;
+	}
+
+	~PerceptronPredictor() { }
+
+	virtual bool predict(ADDRINT ip, ADDRINT target) {
+		this->last_row = ip & ((1 << this->entries_bits) - 1);
+		this->last_output = this->output(this->last_row);
+		return this->last_output >= 0;
+	}
+
+	virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
+		this->train(this->last_row, this->last_output, actual);
+		updateCounters(predicted, actual);
+	}
+
+	virtual bool access(ADDRINT ip, ADDRINT target, bool actual) {
+		unsigned int row = ip & ((1 << this->entries_bits) - 1);
+		INT32 y = this->output(row);
+
+		this->train(row, y, actual);
+		updateCounters(y >= 0, actual);
+		return y >= 0;
+	}
+
+	virtual string getName() {
+		std::ostringstream stream;
+		stream << "Perceptron (entries=" << (1 << this->entries_bits)
+		       << ", history=" << this->history_length << ")";
+		return stream.str();
+	}
+
+	// 8-bit weights and bias, one history bit per weight
+	virtual UINT64 getStorageBits() {
+		return ((UINT64)this->history_length + 1) * 8 * this->bias.size() + this->history_length;
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		ar.io(this->weights);
+		ar.io(this->bias);
+		ar.io(this->history);
+		ar.io(this->history_pos);
+	}
+
+private:
+	int entries_bits, history_length, row_length;
+	INT32 theta;
+	std::vector<INT8> weights; // row_length weights per perceptron
+	std::vector<INT8> bias;
+	std::vector<INT8> history; // +1/-1, newest first, zeros after history_length
+	int history_pos;
+	unsigned int last_row;
+	INT32 last_output;
+
+	INT32 output(unsigned int row) const {
+		return this->bias[row] + PerceptronDot(&this->weights[(size_t)row * this->row_length],
+		                                       &this->history[this->history_pos],
+		                                       this->row_length);
+	}
+
+	void train(unsigned int row, INT32 y, bool actual) {
+		// train on a misprediction or when the output is not confident enough
+		if ((y >= 0) != actual || (y <= this->theta && y >= -this->theta)) {
+			INT8 &b = this->bias[row];
+			if (actual)
+				b += b < 127;
+			else
+				b -= b > -127;
+			PerceptronTrain(&this->weights[(size_t)row * this->row_length],
+			                &this->history[this->history_pos], this->row_length, actual);
+		}
+
+		if (this->history_pos == 0) {
+			std::copy(this->history.begin(), this->history.begin() + this->row_length,
+			          this->history.begin() + this->row_length);
+			this->history_pos = this->row_length;
+		}
+		this->history_pos--;
+		this->history[this->history_pos] = actual ? 1 : -1;
+		// the outcome that leaves the history must not meet a weight
+		this->history[this->history_pos + this->history_length] = 0;
+	}
+};
+
+/**
+ * Hashed perceptron: num_tables tables of 2^entries_bits int8 weights.
+ * Table 0 is indexed by the address alone, table i by the address hashed
+ * with the newest L(i) outcomes, L growing geometrically up to
+ * max_history. The prediction is the sign of the sum of the selected
+ * weights, so the cost per branch depends on the number of tables and not
+ * on the history length.
+ **/
+class HashedPerceptronPredictor : public BranchPredictor {
+public:
+	HashedPerceptronPredictor(int num_tables, int entries_bits, int max_history)
+		: ghist(max_history) {
+		this->num_tables = num_tables;
+		this->entries_bits = entries_bits;
+		this->max_history = max_history;
+		this->theta = 193 * num_tables / 100 + 14;
+		this->weights.resize((size_t)num_tables << entries_bits, 0);
+		this->indices.resize(num_tables);
+
+		this->fold_ids.push_back(0);
+		for (int i = 1; i < num_tables; i++) {
+			double ratio = num_tables > 2 ? (double)(i - 1) / (num_tables - 2) : 1;
+			int len = (int)(2 * pow((double)max_history / 2, ratio) + 0.5);
+			this->fold_ids.push_back(this->ghist.addFold(len, entries_bits));
+		}
+	}
+
+	~HashedPerceptronPredictor() { }
+
+	virtual bool predict(ADDRINT ip, ADDRINT target) {
+		this->last_output = this->output(ip);
+		return this->last_output >= 0;
+	}
+
+	virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
+		this->train(this->last_output, actual);
+		updateCounters(predicted, actual);
+	}
+
+	virtual bool access(ADDRINT ip, ADDRINT target, bool actual) {
+		INT32 y = this->output(ip);
+
+		this->train(y, actual);
+		updateCounters(y >= 0, actual);
+		return y >= 0;
+	}
+
+	virtual string getName() {
+		std::ostringstream stream;
+		stream << "Hashed Perceptron (tables=" << this->num_tables
+		       << ", entries=" << (1 << this->entries_bits)
+		       << ", history=" << this->max_history << ")";
+		return stream.str();
+	}
+
+	virtual UINT64 getStorageBits() {
+		return (UINT64)this->weights.size() * 8 + this->max_history;
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		ar.io(this->weights);
+		this->ghist.serialize(ar);
+	}
+
+private:
+	int num_tables, entries_bits, max_history;
+	INT32 theta;
+	std::vector<INT8> weights; // num_tables << entries_bits
+	HistoryRegister ghist;
+	std::vector<unsigned int> fold_ids;
+	std::vector<unsigned int> indices; // of the last output()
+	INT32 last_output;
+
+	INT32 output(ADDRINT ip) {
+		unsigned int mask = (1 << this->entries_bits) - 1;
+		INT32 y = 0;
+
+		for (int i = 0; i < this->num_tables; i++) {
+			unsigned int index = ip ^ (ip >> (this->entries_bits - i % this->entries_bits));
+			if (i > 0)
+				index ^= this->ghist.folded(this->fold_ids[i]);
+			this->indices[i] = (i << this->entries_bits) + (index & mask);
+			y += this->weights[this->indices[i]];
+		}
+		return y;
+	}
+
+	void train(INT32 y, bool actual) {
+		if ((y >= 0) != actual || (y <= this->theta && y >= -this->theta)) {
+			for (int i = 0; i < this->num_tables; i++) {
+				INT8 &w = this->weights[this->indices[i]];
+				if (actual)
+					w += w < 127;
+				else
+					w -= w > -127;
+			}
+		}
+		this->ghist.push(actual);
+	}
 };
 
 class Alpha21264 : public BranchPredictor {
 public:
 	Alpha21264() {
-		// 12bit shift register for global history
-		global_history = new ShiftRegister(12);
+		// 12bit global history
+		global_history = new HistoryRegister(12);
 		
 		// Choice Predictor is a 2bit predictor with 4K=2^12 entries
 		choice_predictor = new NbitPredictor(12, 2);
@@ -374,7 +716,7 @@ public:
 	}
 
 	virtual bool predict(ADDRINT ip, ADDRINT target) {
-		std::uint16_t history = this->global_history->getValue();
+		std::uint16_t history = this->global_history->value(12);
 		bool choice = this->choice_predictor->predict(history, 0); // it does not use the target
 
 		this->pred0 = this->lhp->predict(ip, target);
@@ -389,11 +731,11 @@ public:
 		if(this->pred0 != actual && this->pred1 == actual)
 			this->choice_predictor->update(predicted, true, ip, target);	
 
-		std::uint16_t history = this->global_history->getValue();
+		std::uint16_t history = this->global_history->value(12);
 		this->lhp->update(predicted, actual, ip, target);
 		this->ghp->update(history, actual, ip, target);
 
-		this->global_history->shiftRight(actual);
+		this->global_history->push(actual);
 
 		updateCounters(predicted, actual);
 	}
@@ -403,8 +745,20 @@ public:
 		stream << "Alpha 21264";
 		return stream.str();
 	}
+
+	virtual UINT64 getStorageBits() {
+		return this->global_history->getLength() + this->ghp->getStorageBits()
+		       + this->lhp->getStorageBits() + this->choice_predictor->getStorageBits();
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		this->global_history->serialize(ar);
+		this->ghp->serializeState(ar);
+		this->lhp->serializeState(ar);
+		this->choice_predictor->serializeState(ar);
+	}
 private:
-	ShiftRegister* global_history;
+	HistoryRegister* global_history;
 	GlobalHistoryPredictor* ghp;
 	LocalHistoryPredictor* lhp;
 	NbitPredictor* choice_predictor;
@@ -453,21 +807,723 @@ public:
 		       << "| Pred1: " << this->pred1->getName() << '\n';
 		return stream.str();
 	}
+
+	virtual UINT64 getStorageBits() {
+		return this->meta->getStorageBits() + this->pred0->getStorageBits()
+		       + this->pred1->getStorageBits();
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		this->meta->serializeState(ar);
+		this->pred0->serializeState(ar);
+		this->pred1->serializeState(ar);
+	}
 private:
 	NbitPredictor* meta;
 	BranchPredictor* pred0; bool p0;
 	BranchPredictor* pred1; bool p1;
 };
 
+/**
+ * Hybrid of 2 to HYBRID_MAX_COMPONENTS predictors. All of them predict and
+ * train on every branch, the arbitration scheme picks the prediction from
+ * tables of 2^table_bits entries:
+ *   HYBRID_META_PC     a 2-bit counter per component, indexed by the
+ *                      address, counts how often the component is right;
+ *                      the highest counter wins (the lowest component on a
+ *                      tie). Trained only when the components disagree, as
+ *                      the tournament meta predictor.
+ *   HYBRID_META_GHIST  the same counters indexed by the newest table_bits
+ *                      outcomes, as the choice predictor of the Alpha 21264.
+ *   HYBRID_PRIORITY    the first component whose 2-bit confidence counter
+ *                      (indexed by the address) is saturated provides the
+ *                      prediction, the last one is the default, as the
+ *                      global -> loop -> bimodal chain of the Pentium M. A
+ *                      counter counts up when its component is right and
+ *                      is reset when it is wrong.
+ *   HYBRID_ADDER       every component adds a signed 8-bit weight, indexed
+ *                      by the address, with the sign of its prediction to a
+ *                      bias weight, and the sign of the sum is the
+ *                      prediction, as a statistical corrector. The weights
+ *                      are trained as a perceptron.
+ **/
+#define HYBRID_MAX_COMPONENTS 8
+
+enum HybridArbitration {
+	HYBRID_META_PC,
+	HYBRID_META_GHIST,
+	HYBRID_PRIORITY,
+	HYBRID_ADDER
+};
+
+class HybridPredictor : public BranchPredictor {
+public:
+	HybridPredictor(HybridArbitration arbitration, int table_bits,
+	                const std::vector<BranchPredictor*> &components)
+		: ghist(table_bits > 0 ? table_bits : 1) {
+		assert(components.size() >= 2 && components.size() <= HYBRID_MAX_COMPONENTS);
+		this->arbitration = arbitration;
+		this->table_bits = table_bits;
+		this->components = components;
+		this->theta = 193 * (components.size() + 1) / 100 + 14;
+
+		int num_tables = arbitration == HYBRID_PRIORITY ? components.size() - 1 : components.size();
+		if (arbitration == HYBRID_ADDER)
+			this->weights.resize((components.size() + 1) << table_bits, 0);
+		else
+			this->counters.resize(num_tables, PackedCounterTable<2>(table_bits));
+	}
+
+	~HybridPredictor() {
+		for (size_t i = 0; i < this->components.size(); i++)
+			delete this->components[i];
+	}
+
+	virtual bool predict(ADDRINT ip, ADDRINT target) {
+		int n = this->components.size();
+
+		this->preds = 0;
+		for (int i = 0; i < n; i++)
+			this->preds |= (UINT32)this->components[i]->predict(ip, target) << i;
+
+		if (this->arbitration == HYBRID_META_GHIST)
+			this->index = this->ghist.value(this->table_bits);
+		else
+			this->index = ip & ((1 << this->table_bits) - 1);
+
+		switch (this->arbitration) {
+		case HYBRID_META_PC:
+		case HYBRID_META_GHIST: {
+			int best = 0;
+			for (int i = 1; i < n; i++)
+				if (this->counters[i].get(this->index) > this->counters[best].get(this->index))
+					best = i;
+			return (this->preds >> best) & 1;
+		}
+		case HYBRID_PRIORITY:
+			for (int i = 0; i < n - 1; i++)
+				if (this->counters[i].get(this->index) == this->counters[i].counterMax())
+					return (this->preds >> i) & 1;
+			return (this->preds >> (n - 1)) & 1;
+		case HYBRID_ADDER:
+		default:
+			this->sum = this->weights[this->index];
+			for (int i = 0; i < n; i++) {
+				INT32 w = this->weights[((i + 1) << this->table_bits) + this->index];
+				this->sum += (this->preds >> i) & 1 ? w : -w;
+			}
+			return this->sum >= 0;
+		}
+	}
+
+	virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
+		int n = this->components.size();
+		UINT32 all = (1u << n) - 1;
+		UINT32 right = actual ? this->preds : ~this->preds & all;
+
+		switch (this->arbitration) {
+		case HYBRID_META_PC:
+		case HYBRID_META_GHIST:
+			if (right != 0 && right != all)
+				for (int i = 0; i < n; i++)
+					this->counters[i].update(this->index, (right >> i) & 1);
+			break;
+		case HYBRID_PRIORITY:
+			for (int i = 0; i < n - 1; i++) {
+				if ((right >> i) & 1)
+					this->counters[i].update(this->index, true);
+				else
+					this->counters[i].set(this->index, 0);
+			}
+			break;
+		case HYBRID_ADDER:
+			if ((this->sum >= 0) != actual || (this->sum <= this->theta && this->sum >= -this->theta)) {
+				this->train(this->weights[this->index], actual);
+				for (int i = 0; i < n; i++)
+					this->train(this->weights[((i + 1) << this->table_bits) + this->index],
+					            (right >> i) & 1);
+			}
+			break;
+		}
+
+		for (int i = 0; i < n; i++)
+			this->components[i]->update((this->preds >> i) & 1, actual, ip, target);
+		this->ghist.push(actual);
+
+		updateCounters(predicted, actual);
+	}
+
+	virtual string getName() {
+		static const char *names[] = { "meta_pc", "meta_ghist", "priority", "adder" };
+		std::ostringstream stream;
+		stream << "Hybrid-" << names[this->arbitration] << "-" << this->table_bits << " (";
+		for (size_t i = 0; i < this->components.size(); i++)
+			stream << (i ? ", " : "") << this->components[i]->getName();
+		stream << ")";
+		return stream.str();
+	}
+
+	virtual UINT64 getStorageBits() {
+		UINT64 bits = (UINT64)this->weights.size() * 8
+		              + ((UINT64)this->counters.size() << this->table_bits) * 2;
+		if (this->arbitration == HYBRID_META_GHIST)
+			bits += this->table_bits;
+		for (size_t i = 0; i < this->components.size(); i++)
+			bits += this->components[i]->getStorageBits();
+		return bits;
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		for (size_t i = 0; i < this->counters.size(); i++)
+			this->counters[i].serialize(ar);
+		ar.io(this->weights);
+		this->ghist.serialize(ar);
+		for (size_t i = 0; i < this->components.size(); i++)
+			this->components[i]->serializeState(ar);
+	}
+
+private:
+	HybridArbitration arbitration;
+	int table_bits;
+	std::vector<BranchPredictor*> components;
+	std::vector<PackedCounterTable<2> > counters; // meta or confidence, one table per component
+	std::vector<INT8> weights; // bias, then one table per component
+	HistoryRegister ghist;
+	INT32 theta;
+	UINT32 preds; // bit i is the last prediction of component i
+	unsigned int index;
+	INT32 sum;
+
+	static void train(INT8 &w, bool up) {
+		if (up)
+			w += w < 127;
+		else
+			w -= w > -127;
+	}
+};
+
+/**
+ * Loop predictor overlay (the loop predictor of TAGE-SC-L): recognises
+ * branches that go the same direction a fixed number of times and then
+ * once the other way, and overrides the prediction of any base predictor
+ * for them. The Pentium M keeps a loop predictor of its own (lpb.h) with a
+ * fixed geometry behind its BTB; this one wraps any direction predictor.
+ *
+ * The entries sets of ways ways hold a tag, the number of iterations of
+ * the last complete run of the loop (past_iter) and of the current one
+ * (iter), both iter_bits wide, the direction of the iterations and a
+ * confidence counter. A hit overrides the base predictor once the same
+ * trip count has been seen confidence times in a row. An entry is
+ * allocated when the base predictor mispredicts a branch without one, in
+ * a way whose 3-bit age has run down; the ages of the set are decremented
+ * instead when none has.
+ *
+ * The mispredictions of the base predictor that the overlay removed, and
+ * the ones it added, are reported by getOverlayStats().
+ **/
+#define LOOP_AGE_MAX 7
+
+class LoopOverlayPredictor : public BranchPredictor {
+public:
+	LoopOverlayPredictor(unsigned entries, unsigned ways, unsigned tag_bits, unsigned iter_bits,
+	                     unsigned confidence, BranchPredictor* base) {
+		assert(ways >= 1 && entries % ways == 0);
+		assert(tag_bits >= 1 && tag_bits <= 16 && iter_bits >= 1 && iter_bits <= 16);
+		assert(confidence >= 1 && confidence <= 255);
+		this->num_sets = entries / ways;
+		this->ways = ways;
+		this->tag_bits = tag_bits;
+		this->iter_bits = iter_bits;
+		this->confidence = confidence;
+		this->base = base;
+		this->removed = this->added = 0;
+		assert((this->num_sets & (this->num_sets - 1)) == 0);
+
+		LoopEntry empty = { 0, 0, 0, 0, 0, 0 };
+		this->table.resize(entries, empty);
+	}
+
+	~LoopOverlayPredictor() {
+		delete base;
+	}
+
+	virtual bool predict(ADDRINT ip, ADDRINT target) {
+		this->base_pred = this->base->predict(ip, target);
+		this->lookup(ip);
+		return this->use_loop ? this->loop_pred : this->base_pred;
+	}
+
+	virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
+		if (this->use_loop && this->loop_pred != this->base_pred) {
+			if (this->loop_pred == actual)
+				this->removed++;
+			else
+				this->added++;
+		}
+		this->train(actual);
+		this->base->update(this->base_pred, actual, ip, target);
+
+		updateCounters(predicted, actual);
+	}
+
+	virtual string getName() {
+		std::ostringstream stream;
+		stream << "Loop (entries=" << this->table.size() << ", ways=" << this->ways
+		       << ", tag=" << this->tag_bits << ", iter=" << this->iter_bits
+		       << ", confidence=" << this->confidence << ") over " << this->base->getName();
+		return stream.str();
+	}
+
+	virtual bool getOverlayStats(UINT64 &removed_, UINT64 &added_) {
+		removed_ = this->removed;
+		added_ = this->added;
+		return true;
+	}
+
+	//> Tag, both iteration counts, confidence, age and direction per entry
+	virtual UINT64 getStorageBits() {
+		return (UINT64)this->table.size()
+		       * (this->tag_bits + 2 * this->iter_bits + CeilLog2(this->confidence + 1)
+		          + CeilLog2(LOOP_AGE_MAX + 1) + 1)
+		       + this->base->getStorageBits();
+	}
+
+	virtual void mergeCounters(BranchPredictor *other) {
+		BranchPredictor::mergeCounters(other);
+		this->removed += ((LoopOverlayPredictor *)other)->removed;
+		this->added += ((LoopOverlayPredictor *)other)->added;
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		ar.io(this->table);
+		this->base->serializeState(ar);
+	}
+
+	virtual void serializeCounters(StateArchive &ar) {
+		BranchPredictor::serializeCounters(ar);
+		ar.io(this->removed);
+		ar.io(this->added);
+	}
+
+private:
+	struct LoopEntry {
+		UINT16 tag;
+		UINT16 past_iter; // 0 until a complete run of the loop was seen
+		UINT16 iter;
+		UINT8 confidence;
+		UINT8 age;
+		UINT8 dir;        // direction of the iterations, the exit goes the other way
+	};
+
+	unsigned num_sets, ways, tag_bits, iter_bits, confidence;
+	std::vector<LoopEntry> table; // set-major, ways entries per set
+	BranchPredictor* base;
+	UINT64 removed, added;
+
+	// state of the last lookup()
+	LoopEntry* set;
+	int hit_way;
+	UINT16 tag;
+	bool base_pred, loop_pred, use_loop;
+
+	void lookup(ADDRINT ip) {
+		unsigned int s = ip & (this->num_sets - 1);
+
+		this->set = &this->table[(size_t)s * this->ways];
+		this->tag = (ip >> CeilLog2(this->num_sets)) & ((1 << this->tag_bits) - 1);
+		this->hit_way = -1;
+		this->use_loop = false;
+		for (unsigned int w = 0; w < this->ways; w++) {
+			if (this->set[w].tag == this->tag && this->set[w].age > 0) {
+				LoopEntry &e = this->set[w];
+				this->hit_way = w;
+				this->loop_pred = e.iter + 1 == e.past_iter ? !e.dir : e.dir;
+				this->use_loop = e.confidence >= this->confidence;
+				break;
+			}
+		}
+	}
+
+	void train(bool actual) {
+		if (this->hit_way < 0) {
+			if (this->base_pred != actual)
+				this->allocate(actual);
+			return;
+		}
+
+		LoopEntry &e = this->set[this->hit_way];
+		if (this->use_loop) {
+			if (this->loop_pred != actual) {
+				e.age = 0; // frees the entry
+				return;
+			}
+			if (this->loop_pred != this->base_pred && e.age < LOOP_AGE_MAX)
+				e.age++;
+		}
+
+		unsigned int iter = e.iter + 1;
+		if (iter >= (1u << this->iter_bits) || (e.past_iter != 0 && iter > e.past_iter)) {
+			// too long for the counters, or longer than the loop was
+			e.age = 0;
+			return;
+		}
+		e.iter = iter;
+		if (actual != (bool)e.dir) {
+			if (e.iter == e.past_iter) {
+				e.confidence += e.confidence < this->confidence;
+			} else if (e.past_iter == 0 && e.iter > 1) {
+				e.past_iter = e.iter;
+				e.confidence = 0;
+			} else {
+				// the trip count changed
+				e.age = 0;
+				return;
+			}
+			e.iter = 0;
+		}
+	}
+
+	//> The base predictor mispredicted, so actual is taken to be the exit
+	//  of a loop that iterates the other way
+	void allocate(bool actual) {
+		for (unsigned int w = 0; w < this->ways; w++) {
+			if (this->set[w].age == 0) {
+				LoopEntry &e = this->set[w];
+				e.tag = this->tag;
+				e.past_iter = 0;
+				e.iter = 0;
+				e.confidence = 0;
+				e.age = LOOP_AGE_MAX;
+				e.dir = !actual;
+				return;
+			}
+		}
+		for (unsigned int w = 0; w < this->ways; w++)
+			this->set[w].age--;
+	}
+};
+
+/**
+ * TAGE: a bimodal base predictor plus num_tables partially tagged tables
+ * indexed with geometrically increasing global history lengths
+ * (min_history ... max_history). The longest matching table provides the
+ * prediction, the next one is the alternate prediction. On a misprediction
+ * an entry is allocated in a longer table whose useful bits are clear; the
+ * useful bits are halved every TAGE_AGING_PERIOD branches.
+ *
+ * All tagged tables live in one contiguous array and the history is folded
+ * incrementally into every index and tag, so the per-branch cost does not
+ * depend on the history lengths.
+ **/
+#define TAGE_AGING_PERIOD (1 << 18)
+
+class TAGEPredictor : public BranchPredictor {
+public:
+	// Picks the largest tables that fit in storage_kbits Kbits, at least
+	// MinStorageKbits()
+	TAGEPredictor(unsigned storage_kbits) : bimodal(1, 2) {
+		unsigned log_entries = 6;
+
+		assert(storage_kbits >= MinStorageKbits());
+		while (SizingBits(log_entries + 1) <= (UINT64)storage_kbits * 1024)
+			log_entries++;
+		this->init(7, log_entries, 11, 4, 160, log_entries + 2);
+	}
+
+	//> The budget of the smallest tables the storage_kbits constructor builds
+	static unsigned MinStorageKbits() {
+		return (SizingBits(6) + 1023) / 1024;
+	}
+
+	TAGEPredictor(unsigned num_tables, unsigned log_entries, unsigned tag_bits,
+	              unsigned min_history, unsigned max_history, unsigned log_bimodal)
+		: bimodal(1, 2) {
+		this->init(num_tables, log_entries, tag_bits, min_history, max_history, log_bimodal);
+	}
+
+	~TAGEPredictor() { }
+
+	virtual bool predict(ADDRINT ip, ADDRINT target) {
+		this->lookup(ip);
+		return this->pred;
+	}
+
+	virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
+		this->train(ip, actual);
+		updateCounters(predicted, actual);
+	}
+
+	virtual bool access(ADDRINT ip, ADDRINT target, bool actual) {
+		this->lookup(ip);
+		bool predicted = this->pred;
+		this->train(ip, actual);
+		updateCounters(predicted, actual);
+		return predicted;
+	}
+
+	virtual string getName() {
+		std::ostringstream stream;
+		stream << "TAGE-" << this->getTableBits() / 1024.0 << "Kbit (tables="
+		       << this->num_tables << ", entries=" << (1 << this->log_entries)
+		       << ", history=" << this->history_lengths[0] << "-"
+		       << this->history_lengths[this->num_tables - 1] << ")";
+		return stream.str();
+	}
+
+	//> The tables plus the global and path histories, the 4-bit
+	//  use_alt_on_na counter and the counter of the aging period
+	virtual UINT64 getStorageBits() {
+		return this->getTableBits() + this->ghist.getLength() + 16 + 4
+		       + CeilLog2(TAGE_AGING_PERIOD);
+	}
+
+	//> The budget in the name, which the storage_kbits constructor fills
+	UINT64 getTableBits() {
+		return (UINT64)this->bimodal.size() * 2
+		       + (UINT64)this->num_tables * (1 << this->log_entries) * (3 + 2 + 1 + this->tag_bits);
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		this->bimodal.serialize(ar);
+		ar.io(this->tables);
+		this->ghist.serialize(ar);
+		ar.io(this->phist);
+		ar.io(this->use_alt_on_na);
+		ar.io(this->num_branches);
+		ar.io(this->seed);
+	}
+
+private:
+	struct TageEntry {
+		INT8 ctr;   // 3-bit signed counter, taken when >= 0
+		UINT8 u;    // 2-bit useful counter
+		UINT8 valid; // never allocated entries match no tag
+		UINT16 tag;
+	};
+
+	unsigned num_tables, log_entries, tag_bits;
+	std::vector<unsigned> history_lengths;
+	PackedCounterTable<> bimodal;
+	std::vector<TageEntry> tables; // num_tables << log_entries entries
+	HistoryRegister ghist;
+	UINT32 phist; // path history, one address bit per branch
+	std::vector<unsigned> index_fold, tag_fold0, tag_fold1; // ghist fold ids
+	INT32 use_alt_on_na;
+	UINT64 num_branches;
+	UINT32 seed;
+
+	// state of the last lookup()
+	std::vector<unsigned> indices;
+	std::vector<UINT16> tags;
+	int provider, alt_provider;
+	bool pred, alt_pred, provider_weak;
+
+	// The 7 tables of 2^log_entries entries of 3 counter + 2 useful + 1
+	// valid + 11 tag bits, and a bimodal table with 4 times as many 2-bit
+	// entries, of the storage_kbits constructor
+	static UINT64 SizingBits(unsigned log_entries) {
+		return (UINT64)(8 + 7 * 17) << log_entries;
+	}
+
+	// tag_bits >= 2, tag_fold1 folds the history into tag_bits - 1 bits
+	void init(unsigned num_tables, unsigned log_entries, unsigned tag_bits,
+	          unsigned min_history, unsigned max_history, unsigned log_bimodal) {
+		assert(num_tables >= 1 && tag_bits >= 2 && tag_bits <= 16 && min_history >= 1);
+		this->num_tables = num_tables;
+		this->log_entries = log_entries;
+		this->tag_bits = tag_bits;
+		this->bimodal = PackedCounterTable<>(log_bimodal, 2);
+		this->tables.resize(num_tables << log_entries);
+		for (std::size_t i = 0; i < this->tables.size(); i++)
+			this->tables[i].ctr = this->tables[i].u = this->tables[i].valid = this->tables[i].tag = 0;
+		this->phist = 0;
+		this->use_alt_on_na = 0;
+		this->num_branches = 0;
+		this->seed = 0x2545F491;
+		this->indices.resize(num_tables);
+		this->tags.resize(num_tables);
+
+		// geometric series of history lengths
+		for (unsigned i = 0; i < num_tables; i++) {
+			double ratio = num_tables > 1 ? (double)i / (num_tables - 1) : 0;
+			unsigned len = (unsigned)(min_history * pow((double)max_history / min_history, ratio) + 0.5);
+			if (i > 0 && len <= this->history_lengths[i - 1])
+				len = this->history_lengths[i - 1] + 1;
+			this->history_lengths.push_back(len);
+		}
+
+		this->ghist = HistoryRegister(this->history_lengths[num_tables - 1]);
+		for (unsigned i = 0; i < num_tables; i++) {
+			this->index_fold.push_back(this->ghist.addFold(this->history_lengths[i], log_entries));
+			this->tag_fold0.push_back(this->ghist.addFold(this->history_lengths[i], tag_bits));
+			this->tag_fold1.push_back(this->ghist.addFold(this->history_lengths[i], tag_bits - 1));
+		}
+	}
+
+	TageEntry &entry(unsigned table) {
+		return this->tables[(table << this->log_entries) + this->indices[table]];
+	}
+
+	void lookup(ADDRINT ip) {
+		unsigned index_mask = (1u << this->log_entries) - 1;
+
+		this->provider = this->alt_provider = -1;
+		for (int i = this->num_tables - 1; i >= 0; i--) {
+			unsigned len = this->history_lengths[i];
+			UINT32 path = this->phist & ((1u << (len < 16 ? len : 16)) - 1);
+
+			this->indices[i] = (ip ^ (ip >> (this->log_entries - i % this->log_entries))
+			                    ^ this->ghist.folded(this->index_fold[i])
+			                    ^ path ^ (path >> this->log_entries)) & index_mask;
+			this->tags[i] = (ip ^ this->ghist.folded(this->tag_fold0[i])
+			                 ^ (this->ghist.folded(this->tag_fold1[i]) << 1))
+			                & ((1u << this->tag_bits) - 1);
+
+			if (this->entry(i).valid && this->entry(i).tag == this->tags[i]) {
+				if (this->provider < 0)
+					this->provider = i;
+				else if (this->alt_provider < 0)
+					this->alt_provider = i;
+			}
+		}
+
+		bool base_pred = this->bimodal.predict(ip & (this->bimodal.size() - 1));
+		this->alt_pred = this->alt_provider >= 0 ? this->entry(this->alt_provider).ctr >= 0
+		                                         : base_pred;
+		if (this->provider < 0) {
+			this->pred = this->alt_pred;
+			this->provider_weak = false;
+			return;
+		}
+
+		TageEntry &e = this->entry(this->provider);
+		// a newly allocated entry is often worse than the alternate prediction
+		this->provider_weak = (e.ctr == 0 || e.ctr == -1) && e.u == 0;
+		if (this->provider_weak && this->use_alt_on_na >= 0)
+			this->pred = this->alt_pred;
+		else
+			this->pred = e.ctr >= 0;
+	}
+
+	void train(ADDRINT ip, bool actual) {
+		bool provider_pred = this->provider >= 0 ? this->entry(this->provider).ctr >= 0
+		                                         : this->alt_pred;
+
+		if (this->provider >= 0 && this->provider_weak && provider_pred != this->alt_pred) {
+			if (this->alt_pred == actual)
+				this->use_alt_on_na += this->use_alt_on_na < 7;
+			else
+				this->use_alt_on_na -= this->use_alt_on_na > -8;
+		}
+
+		// allocate in a longer table on a misprediction
+		if (provider_pred != actual && this->provider < (int)this->num_tables - 1)
+			this->allocate(actual);
+
+		if (this->provider >= 0) {
+			TageEntry &e = this->entry(this->provider);
+			// train the alternate too while the provider is not trusted
+			if (e.u == 0)
+				this->trainAlt(ip, actual);
+			if (actual)
+				e.ctr += e.ctr < 3;
+			else
+				e.ctr -= e.ctr > -4;
+			if (provider_pred != this->alt_pred) {
+				if (provider_pred == actual)
+					e.u += e.u < 3;
+				else
+					e.u -= e.u > 0;
+			}
+		} else {
+			this->bimodal.update(ip & (this->bimodal.size() - 1), actual);
+		}
+
+		// periodic aging of the useful bits
+		if (++this->num_branches % TAGE_AGING_PERIOD == 0)
+			for (std::size_t i = 0; i < this->tables.size(); i++)
+				this->tables[i].u >>= 1;
+
+		this->ghist.push(actual);
+		this->phist = ((this->phist << 1) | (ip & 1)) & 0xffff;
+	}
+
+	void trainAlt(ADDRINT ip, bool actual) {
+		if (this->alt_provider >= 0) {
+			TageEntry &e = this->entry(this->alt_provider);
+			if (actual)
+				e.ctr += e.ctr < 3;
+			else
+				e.ctr -= e.ctr > -4;
+		} else {
+			this->bimodal.update(ip & (this->bimodal.size() - 1), actual);
+		}
+	}
+
+	void allocate(bool actual) {
+		unsigned start = this->provider + 1;
+
+		// skip one table at random, so that allocations spread over the tables
+		this->seed ^= this->seed << 13;
+		this->seed ^= this->seed >> 17;
+		this->seed ^= this->seed << 5;
+		if ((this->seed & 1) && start + 1 < this->num_tables)
+			start++;
+
+		for (unsigned i = start; i < this->num_tables; i++) {
+			TageEntry &e = this->entry(i);
+			if (e.u == 0) {
+				e.valid = 1;
+				e.tag = this->tags[i];
+				e.ctr = actual ? 0 : -1;
+				return;
+			}
+		}
+
+		// no room, make the entries a little less useful
+		for (unsigned i = this->provider + 1; i < this->num_tables; i++) {
+			TageEntry &e = this->entry(i);
+			e.u -= e.u > 0;
+		}
+	}
+};
+
+/**
+ * Replacement policies of BTBPredictor. BTB_LRU is the true LRU of the
+ * original list based BTB; BTB_PLRU is a tree pseudo-LRU (power of two
+ * associativity, otherwise true LRU is used); BTB_RANDOM picks a random way.
+ * All of them fill an empty way before evicting anything.
+ **/
+enum BTBReplacement {
+	BTB_LRU = 0,
+	BTB_PLRU,
+	BTB_RANDOM
+};
+
+// An address no branch can have marks an empty BTB way
+#define BTB_INVALID_TAG (~(ADDRINT)0)
+// The PLRU tree of a set (assoc - 1 bits) lives in one UINT64 and the LRU
+// ages in UINT8s, so the associativity is limited to 64
+#define BTB_MAX_ASSOC 64
+
 // Fill in the BTB implementation ...
 class BTBPredictor : public BranchPredictor
 {
 public:
-	BTBPredictor(int btb_lines, int btb_assoc)
-	     : table_lines(btb_lines), table_assoc(btb_assoc), correct_target_predictions(0)
+	BTBPredictor(int btb_lines, int btb_assoc, BTBReplacement replacement = BTB_LRU)
+	     : table_lines(btb_lines), table_assoc(btb_assoc), replacement(replacement),
+	       correct_target_predictions(0), seed(0x9E3779B9)
 	{
+		assert(btb_assoc >= 1 && btb_assoc <= BTB_MAX_ASSOC && btb_lines % btb_assoc == 0);
 		this->num_sets = btb_lines / btb_assoc;
-		sets.resize(this->num_sets);
+		if (replacement == BTB_PLRU && (btb_assoc & (btb_assoc - 1)) != 0)
+			this->replacement = BTB_LRU;
+
+		// all the ways of a set are next to each other
+		tags.resize(btb_lines, BTB_INVALID_TAG);
+		targets.resize(btb_lines, 0);
+		ages.resize(btb_lines, 0);
+		plru.resize(this->num_sets, 0);
 	}
 
 	~BTBPredictor() { }
@@ -475,81 +1531,237 @@ public:
 	virtual bool predict(ADDRINT ip, ADDRINT target) {
 		// find ip's set
 		unsigned int index = ip % this->num_sets;
-		std::list<BufferEntry>& s = this->sets[index];
-		
-		for(auto it = s.begin(); it != s.end(); it++) {
-			if(it->ip == ip) { // found the instruction address
-				BufferEntry be = *it;
-				s.erase(it);
-				s.push_front(be); // move to the front of the list
-						  
-				if(be.target == target) {
-					correct_target_predictions++;
-					return true;
-				} else {
-					return false;
-				}
-			}
-		}
+		int way = this->find(index, ip);
+
+		if (way < 0)
+			return false;
 
+		this->touch(index, way); // move to the front of the list
+		if (this->targets[index * this->table_assoc + way] == target) {
+			correct_target_predictions++;
+			return true;
+		}
 		return false;
 	}
 
 	virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
 		unsigned int index = ip % this->num_sets;
-		std::list<BufferEntry>& s = this->sets[index];
-		
-		for(auto it = s.begin(); it != s.end(); it++) {
-			if(it->ip == ip) {
-				if(actual) { // was branch taken?
-					BufferEntry be = *it;
-					s.erase(it);
-					s.push_front(be);
-				} else { // branch was not taken
-					s.erase(it);
-				}
-
-        			updateCounters(predicted, actual);
-				return;
-			}
-		}
+		int way = this->find(index, ip);
 
-		// not found in BTB and he instruction is a taken branch
-		if(actual) {
-			// if size of the set is max remove LRU element
-			if((int)s.size() >= this->table_assoc) s.pop_back();
+		if (way >= 0) {
+			if (actual) // was branch taken?
+				this->touch(index, way);
+			else // branch was not taken
+				this->invalidate(index, way);
 
-			// now add the new BufferEntry at the start of the list
-			s.push_front({ip, target});
+			updateCounters(predicted, actual);
+			return;
 		}
-        	
+
+		// not found in BTB and the instruction is a taken branch
+		if (actual) {
+			way = this->victim(index);
+			this->tags[index * this->table_assoc + way] = ip;
+			this->targets[index * this->table_assoc + way] = target;
+			this->insert(index, way);
+		}
+
 		updateCounters(predicted, actual);
 	}
 
 	virtual string getName() { 
-        	std::ostringstream stream;
+		std::ostringstream stream;
 		stream << "BTB-" << table_lines << "-" << table_assoc;
+		if (this->replacement == BTB_PLRU)
+			stream << "-plru";
+		else if (this->replacement == BTB_RANDOM)
+			stream << "-random";
 		return stream.str();
 	}
 
-    	UINT64 getNumCorrectTargetPredictions() { 
+	//> Every way holds a valid bit, the address bits above the set index as
+	//  the tag and a full target, plus the replacement state of its set
+	virtual UINT64 getStorageBits() {
+		unsigned tag_bits = 8 * sizeof(ADDRINT) - CeilLog2(this->num_sets);
+		UINT64 replacement_bits;
+
+		if (this->replacement == BTB_LRU)
+			replacement_bits = (UINT64)this->table_lines * CeilLog2(this->table_assoc);
+		else if (this->replacement == BTB_PLRU)
+			replacement_bits = (UINT64)this->num_sets * (this->table_assoc - 1);
+		else
+			replacement_bits = 0;
+		return (UINT64)this->table_lines * (1 + tag_bits + 8 * sizeof(ADDRINT)) + replacement_bits;
+	}
+
+	UINT64 getNumCorrectTargetPredictions() { 
 		return this->correct_target_predictions;
 	}
 
+	virtual void mergeCounters(BranchPredictor *other) {
+		BranchPredictor::mergeCounters(other);
+		this->correct_target_predictions += ((BTBPredictor *)other)->correct_target_predictions;
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		ar.io(this->tags);
+		ar.io(this->targets);
+		ar.io(this->ages);
+		ar.io(this->plru);
+		ar.io(this->seed);
+	}
+
+	virtual void serializeCounters(StateArchive &ar) {
+		BranchPredictor::serializeCounters(ar);
+		ar.io(this->correct_target_predictions);
+	}
+
 private:
 	int table_lines, table_assoc, num_sets;
-
-	struct BufferEntry {
-		ADDRINT ip;
-		ADDRINT target;
-	};
+	BTBReplacement replacement;
 
 	UINT64 correct_target_predictions;
-	
-	// using vector of lists to implement LRU update
-	// each set has a list of BufferEntry with size table_assoc
-	std::vector< std::list<BufferEntry> > sets; 
+
+	std::vector<ADDRINT> tags;
+	std::vector<ADDRINT> targets;
+	// LRU position of every valid way, 0 is the most recently used
+	std::vector<UINT8> ages;
+	// tree pseudo-LRU bits of every set
+	std::vector<UINT64> plru;
+	UINT32 seed;
+
+	int find(unsigned int index, ADDRINT ip) const {
+		const ADDRINT *set = &this->tags[index * this->table_assoc];
+		int way = 0;
+
+#if defined(__AVX2__)
+		if (sizeof(ADDRINT) == 8 && this->table_assoc >= 4) {
+			__m256i key = _mm256_set1_epi64x(ip);
+			for (; way + 4 <= this->table_assoc; way += 4) {
+				__m256i t = _mm256_loadu_si256((const __m256i *)(set + way));
+				int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t, key)));
+				if (mask)
+					return way + __builtin_ctz(mask);
+			}
+		}
+#elif defined(__SSE2__)
+		if (sizeof(ADDRINT) == 8 && this->table_assoc >= 4) {
+			__m128i key = _mm_set1_epi64x(ip);
+			for (; way + 2 <= this->table_assoc; way += 2) {
+				__m128i t = _mm_loadu_si128((const __m128i *)(set + way));
+				// both 32-bit halves of a 64-bit tag have to match
+				__m128i eq = _mm_cmpeq_epi32(t, key);
+				eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, 0xb1));
+				int mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+				if (mask)
+					return way + __builtin_ctz(mask);
+			}
+		}
+#endif
+		for (; way < this->table_assoc; way++)
+			if (set[way] == ip)
+				return way;
+		return -1;
+	}
+
+	bool valid(unsigned int index, int way) const {
+		return this->tags[index * this->table_assoc + way] != BTB_INVALID_TAG;
+	}
+
+	// way becomes the most recently used
+	void touch(unsigned int index, int way) {
+		UINT8 *age = &this->ages[index * this->table_assoc];
+
+		if (this->replacement == BTB_PLRU) {
+			this->touchPLRU(index, way);
+			return;
+		}
+		for (int w = 0; w < this->table_assoc; w++)
+			if (age[w] < age[way] && this->valid(index, w))
+				age[w]++;
+		age[way] = 0;
+	}
+
+	// way was just filled and becomes the most recently used
+	void insert(unsigned int index, int way) {
+		UINT8 *age = &this->ages[index * this->table_assoc];
+
+		if (this->replacement == BTB_PLRU) {
+			this->touchPLRU(index, way);
+			return;
+		}
+		for (int w = 0; w < this->table_assoc; w++)
+			if (w != way && this->valid(index, w))
+				age[w]++;
+		age[way] = 0;
+	}
+
+	void invalidate(unsigned int index, int way) {
+		UINT8 *age = &this->ages[index * this->table_assoc];
+
+		this->tags[index * this->table_assoc + way] = BTB_INVALID_TAG;
+		// keep the ages of the remaining ways contiguous
+		for (int w = 0; w < this->table_assoc; w++)
+			if (age[w] > age[way] && this->valid(index, w))
+				age[w]--;
+	}
+
+	int victim(unsigned int index) {
+		UINT8 *age = &this->ages[index * this->table_assoc];
+		int way;
+
+		for (way = 0; way < this->table_assoc; way++)
+			if (!this->valid(index, way))
+				return way;
+
+		switch (this->replacement) {
+		case BTB_PLRU:
+			return this->victimPLRU(index);
+		case BTB_RANDOM:
+			this->seed ^= this->seed << 13;
+			this->seed ^= this->seed >> 17;
+			this->seed ^= this->seed << 5;
+			return this->seed % this->table_assoc;
+		case BTB_LRU:
+		default:
+			for (way = 0; way < this->table_assoc; way++)
+				if (age[way] == this->table_assoc - 1)
+					break;
+			return way;
+		}
+	}
+
+	// Tree pseudo-LRU: node n has children 2n+1 and 2n+2, a set bit means
+	// that the victim is in the right subtree
+	void touchPLRU(unsigned int index, int way) {
+		UINT64 &bits = this->plru[index];
+		int node = 0;
+
+		for (int size = this->table_assoc; size > 1; size /= 2) {
+			bool right = way >= size / 2;
+			if (right) {
+				bits &= ~(1ULL << node);
+				way -= size / 2;
+			} else {
+				bits |= 1ULL << node;
+			}
+			node = 2 * node + (right ? 2 : 1);
+		}
+	}
+
+	int victimPLRU(unsigned int index) const {
+		UINT64 bits = this->plru[index];
+		int node = 0, way = 0;
+
+		for (int size = this->table_assoc; size > 1; size /= 2) {
+			bool right = (bits >> node) & 1;
+			if (right)
+				way += size / 2;
+			node = 2 * node + (right ? 2 : 1);
+		}
+		return way;
+	}
 };
 
 
-#endif
\ No newline at end of file
+#endif
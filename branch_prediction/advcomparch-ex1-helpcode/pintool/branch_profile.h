@@ -0,0 +1,267 @@
+#ifndef BRANCH_PROFILE_H
+#define BRANCH_PROFILE_H
+
+/**
+ * Fixed size profiles of the static branches that matter most.
+ *
+ * BranchProfile reports the K static branches with the most mispredictions
+ * of one predictor. Counting every misprediction would cost more than the
+ * predictor itself, so it samples one misprediction in BRANCH_PROFILE_SAMPLE
+ * on average, at random intervals, and counts each sample for that many.
+ * A branch with m mispredictions gets an estimate off by about
+ * sqrt(BRANCH_PROFILE_SAMPLE * m): 11% of 5000 of them, 1% of a million.
+ *
+ * The samples go to BRANCH_PROFILE_CANDIDATES * K tracked branches, kept
+ * with filtered space-saving: a branch that is not tracked only counts in a
+ * small table of hashed counters, and once its counter passes the fewest
+ * mispredictions of a tracked branch it replaces that branch, inheriting
+ * the counter as the error bound of its own. The replaced branch leaves
+ * its count in its own filter counter. Every branch with more than
+ * total / (BRANCH_PROFILE_CANDIDATES * K) sampled mispredictions is
+ * guaranteed to be tracked, and as the long tail of rarely mispredicted
+ * branches stays in the filter, replacements are rare.
+ *
+ * BranchCountSketch counts the executions and the taken outcomes of every
+ * conditional branch in a count-min sketch, which never underestimates and
+ * is shared by the profiles of all the predictors. Both counts of a cell
+ * are next to each other, so a row costs one cache line.
+ *
+ * Both take the same memory however many static branches the program has.
+ **/
+
+#include <vector>
+#include <algorithm>
+
+#include "branch_trace.h"
+
+// Branches tracked for every one reported, filter counters for every
+// tracked branch (BRANCH_PROFILE_MIN_FILTER at least), and mispredictions
+// for every sampled one
+#define BRANCH_PROFILE_CANDIDATES 16
+#define BRANCH_PROFILE_FILTER 2
+#define BRANCH_PROFILE_MIN_FILTER (1 << 12)
+#define BRANCH_PROFILE_SAMPLE 64
+
+class BranchProfile
+{
+public:
+    struct Entry {
+        ADDRINT ip;
+        UINT64 mispredictions;
+        UINT64 error;   // mispredictions counted before ip was tracked, at most
+                        // (both in sampled mispredictions times BRANCH_PROFILE_SAMPLE)
+    };
+
+    BranchProfile(UINT32 num_entries)
+      : num_reported(num_entries), max_entries(num_entries * BRANCH_PROFILE_CANDIDATES) {
+        UINT32 slots = 2;
+        while (slots < 2 * max_entries)
+            slots <<= 1;
+        heap.reserve(max_entries);
+        heap_slot.reserve(max_entries);
+        slot.assign(slots, 0);
+        filter.assign(std::max<UINT32>(slots * BRANCH_PROFILE_FILTER, BRANCH_PROFILE_MIN_FILTER), 0);
+        sample_state = 0x9E3779B97F4A7C15ULL;
+        until_sample = nextSample();
+    };
+
+    //> Takes every prediction, so that the caller needs no branch on the
+    //  outcome. Only the sampled mispredictions reach the tracked set, each
+    //  one standing for BRANCH_PROFILE_SAMPLE of them.
+    void addPrediction(ADDRINT ip, bool mispredicted) {
+        until_sample -= mispredicted;
+        if (until_sample)
+            return;
+        until_sample = nextSample();
+        count(ip, BRANCH_PROFILE_SAMPLE);
+    }
+
+    //> The reported branches, the most mispredictions for sure
+    //  (mispredictions - error) first
+    std::vector<Entry> getTop() const {
+        std::vector<Entry> top(heap);
+        std::sort(top.begin(), top.end(), MoreMispredicted);
+        if (top.size() > num_reported)
+            top.resize(num_reported);
+        return top;
+    }
+
+private:
+    //> Mispredictions to the next sample, from 1 to 2 * BRANCH_PROFILE_SAMPLE - 1
+    //  (xorshift), so that no loop can keep a branch out of the sample
+    UINT32 nextSample() {
+        sample_state ^= sample_state << 13;
+        sample_state ^= sample_state >> 7;
+        sample_state ^= sample_state << 17;
+        return 1 + (UINT32)(sample_state % (2 * BRANCH_PROFILE_SAMPLE - 1));
+    }
+
+    void count(ADDRINT ip, UINT64 n) {
+        UINT32 s = find(ip);
+        UINT32 pos;
+
+        if (slot[s]) {
+            pos = slot[s] - 1;
+            heap[pos].mispredictions += n;
+        } else if (heap.size() < max_entries) {
+            Entry e = { ip, n, 0 };
+            pos = heap.size();
+            heap.push_back(e);
+            heap_slot.push_back(s);
+            slot[s] = pos + 1;
+            siftUp(pos);
+            return;
+        } else {
+            UINT64 &untracked = filter[filterIndex(ip)];
+            if (untracked + n <= heap[0].mispredictions) {
+                untracked += n;
+                return;
+            }
+            // Take over the slot of the least mispredicted branch, which
+            // leaves its count in the filter
+            UINT64 &evicted = filter[filterIndex(heap[0].ip)];
+            evicted = std::max(evicted, heap[0].mispredictions);
+            pos = 0;
+            erase(heap_slot[0]);
+            heap[0].error = untracked;
+            heap[0].mispredictions = untracked + n;
+            heap[0].ip = ip;
+            s = find(ip);
+            heap_slot[0] = s;
+            slot[s] = 1;
+        }
+        siftDown(pos);
+    }
+
+    static bool MoreMispredicted(const Entry &a, const Entry &b) {
+        UINT64 sure_a = a.mispredictions - a.error, sure_b = b.mispredictions - b.error;
+        if (sure_a != sure_b)
+            return sure_a > sure_b;
+        return a.mispredictions != b.mispredictions ? a.mispredictions > b.mispredictions
+                                                    : a.ip < b.ip;
+    }
+
+    UINT32 filterIndex(ADDRINT ip) const {
+        return (UINT32)((ip * 0xC2B2AE3D27D4EB4FULL) >> 32) & (filter.size() - 1);
+    }
+
+    //> Slot of ip in the index, or the empty slot where it would go
+    UINT32 find(ADDRINT ip) const {
+        UINT32 mask = slot.size() - 1;
+        UINT32 s = (UINT32)((ip * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+        while (slot[s] && heap[slot[s] - 1].ip != ip)
+            s = (s + 1) & mask;
+        return s;
+    }
+
+    //> Linear probing deletion: moves back the entries that probed past s
+    void erase(UINT32 s) {
+        UINT32 mask = slot.size() - 1;
+        UINT32 next = (s + 1) & mask;
+
+        while (slot[next]) {
+            ADDRINT ip = heap[slot[next] - 1].ip;
+            UINT32 home = (UINT32)((ip * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+            if (((next - home) & mask) >= ((next - s) & mask)) {
+                slot[s] = slot[next];
+                heap_slot[slot[s] - 1] = s;
+                s = next;
+            }
+            next = (next + 1) & mask;
+        }
+        slot[s] = 0;
+    }
+
+    //> Min-heap on the mispredictions, the index follows every move
+    void swapEntries(UINT32 a, UINT32 b) {
+        std::swap(heap[a], heap[b]);
+        std::swap(heap_slot[a], heap_slot[b]);
+        slot[heap_slot[a]] = a + 1;
+        slot[heap_slot[b]] = b + 1;
+    }
+
+    void siftUp(UINT32 pos) {
+        while (pos > 0 && heap[(pos - 1) / 2].mispredictions > heap[pos].mispredictions) {
+            swapEntries(pos, (pos - 1) / 2);
+            pos = (pos - 1) / 2;
+        }
+    }
+
+    void siftDown(UINT32 pos) {
+        while (true) {
+            UINT32 smallest = pos, left = 2 * pos + 1, right = 2 * pos + 2;
+            if (left < heap.size() && heap[left].mispredictions < heap[smallest].mispredictions)
+                smallest = left;
+            if (right < heap.size() && heap[right].mispredictions < heap[smallest].mispredictions)
+                smallest = right;
+            if (smallest == pos)
+                return;
+            swapEntries(pos, smallest);
+            pos = smallest;
+        }
+    }
+
+    UINT32 num_reported, max_entries;
+    std::vector<Entry> heap;
+    std::vector<UINT32> heap_slot; // index slot of every heap entry, so moves need no lookup
+    std::vector<UINT32> slot;   // open addressed index: heap position + 1, 0 if empty
+    std::vector<UINT64> filter; // mispredictions of the untracked branches, at most, by hash
+    UINT64 sample_state;
+    UINT32 until_sample;
+};
+
+#define BRANCH_SKETCH_DEPTH 4
+
+class BranchCountSketch
+{
+public:
+    BranchCountSketch(UINT32 width_bits = 14)
+        : width_bits(width_bits), cells(BRANCH_SKETCH_DEPTH << width_bits) {};
+
+    //> A cell stops counting at 2^32 - 1 executions, which it then reports
+    void add(ADDRINT ip, BOOL was_taken) {
+        for (UINT32 row = 0; row < BRANCH_SKETCH_DEPTH; row++) {
+            Cell &cell = cells[index(ip, row)];
+            if (cell.executions != ~0u) {
+                cell.executions++;
+                cell.taken += was_taken ? 1 : 0;
+            }
+        }
+    }
+
+    void addBatch(const BranchRecord *batch, UINT32 num_records) {
+        for (UINT32 i = 0; i < num_records; i++)
+            if (batch[i].kind == BRANCH_COND)
+                add(batch[i].ip, batch[i].taken);
+    }
+
+    UINT64 getExecutions(ADDRINT ip) const { return estimate(&Cell::executions, ip); }
+    UINT64 getTaken(ADDRINT ip) const { return estimate(&Cell::taken, ip); }
+
+private:
+    struct Cell {
+        UINT32 executions, taken;
+        Cell() : executions(0), taken(0) {}
+    };
+
+    UINT32 index(ADDRINT ip, UINT32 row) const {
+        // A different multiplicative hash per row
+        static const UINT64 seeds[BRANCH_SKETCH_DEPTH] = {
+            0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+            0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL
+        };
+        return (row << width_bits) + (UINT32)((ip * seeds[row]) >> (64 - width_bits));
+    }
+
+    UINT64 estimate(UINT32 Cell::*count, ADDRINT ip) const {
+        UINT32 result = cells[index(ip, 0)].*count;
+        for (UINT32 row = 1; row < BRANCH_SKETCH_DEPTH; row++)
+            result = std::min(result, cells[index(ip, row)].*count);
+        return result;
+    }
+
+    UINT32 width_bits;
+    std::vector<Cell> cells;
+};
+
+#endif
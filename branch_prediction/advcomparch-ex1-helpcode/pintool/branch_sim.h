@@ -0,0 +1,402 @@
+#ifndef BRANCH_SIM_H
+#define BRANCH_SIM_H
+
+/**
+ * Predictor configurations and the per-branch simulation loops.
+ * Shared by the cslab_branch pintool and the Pin-free bp_replay driver,
+ * so that both produce the same output for the same branch stream.
+ **/
+
+#include <ostream>
+#include <iomanip>
+#include <vector>
+
+#include "branch_predictor.h"
+#include "predictor_engine.h"
+#include "indirect_predictor.h"
+#include "pentium_m_predictor/pentium_m_branch_predictor.h"
+#include "pentium_m_predictor/pentium_m_indirect_predictor.h"
+#include "ras.h"
+#include "branch_trace.h"
+#include "branch_profile.h"
+
+typedef std::vector<BranchPredictor *>::iterator bp_iterator_t;
+typedef std::vector<BTBPredictor *>::iterator btb_iterator_t;
+typedef std::vector<RASGroup *>::iterator ras_vec_iterator_t;
+typedef std::vector<IndirectPredictor *>::iterator ibp_iterator_t;
+
+/* ===================================================================== */
+
+inline VOID SimulateCondBranch(std::vector<BranchPredictor *> &branch_predictors,
+                               ADDRINT ip, ADDRINT target, BOOL taken)
+{
+    bp_iterator_t bp_it;
+
+    for (bp_it = branch_predictors.begin(); bp_it != branch_predictors.end(); ++bp_it) {
+        BranchPredictor *curr_predictor = *bp_it;
+        curr_predictor->access(ip, target, taken);
+    }
+}
+
+inline VOID SimulateBTB(std::vector<BTBPredictor *> &btb_predictors,
+                        ADDRINT ip, ADDRINT target, BOOL taken)
+{
+    btb_iterator_t btb_it;
+    BOOL pred;
+
+    for (btb_it = btb_predictors.begin(); btb_it != btb_predictors.end(); ++btb_it) {
+        BTBPredictor *curr_predictor = *btb_it;
+        pred = curr_predictor->predict(ip, target);
+        curr_predictor->update(pred, taken, ip, target);
+    }
+}
+
+inline VOID SimulateCall(std::vector<RASGroup *> &ras_vec, ADDRINT ip, UINT32 ins_size)
+{
+    ras_vec_iterator_t ras_it;
+
+    for (ras_it = ras_vec.begin(); ras_it != ras_vec.end(); ++ras_it) {
+        RASGroup *ras = *ras_it;
+        ras->push_addr(ip + ins_size);
+    }
+}
+
+inline VOID SimulateRet(std::vector<RASGroup *> &ras_vec, ADDRINT target)
+{
+    ras_vec_iterator_t ras_it;
+
+    for (ras_it = ras_vec.begin(); ras_it != ras_vec.end(); ++ras_it) {
+        RASGroup *ras = *ras_it;
+        ras->pop_addr(target);
+    }
+}
+
+/**
+ * Runs a whole batch of branches through the given predictors and RAS. Every
+ * predictor goes over the batch on its own, so its tables stay hot in the
+ * cache, and it sees the branches in program order, so the counters are the
+ * same as when simulating one branch at a time.
+ **/
+inline VOID SimulateBatch(std::vector<BranchPredictor *> &branch_predictors,
+                          std::vector<BTBPredictor *> &btb_predictors,
+                          std::vector<RASGroup *> &ras_vec,
+                          std::vector<IndirectPredictor *> &indirect_predictors,
+                          const BranchRecord *batch, UINT32 num_records)
+{
+    bp_iterator_t bp_it;
+    btb_iterator_t btb_it;
+    ras_vec_iterator_t ras_it;
+    ibp_iterator_t ibp_it;
+    BOOL pred;
+
+    for (bp_it = branch_predictors.begin(); bp_it != branch_predictors.end(); ++bp_it) {
+        BranchPredictor *curr_predictor = *bp_it;
+        curr_predictor->accessBatch(batch, num_records);
+    }
+
+    for (btb_it = btb_predictors.begin(); btb_it != btb_predictors.end(); ++btb_it) {
+        BTBPredictor *curr_predictor = *btb_it;
+        for (UINT32 i = 0; i < num_records; i++) {
+            const BranchRecord &rec = batch[i];
+            if (rec.kind != BRANCH_COND && !IsJumpKind(rec.kind))
+                continue;
+            pred = curr_predictor->predict(rec.ip, rec.target);
+            curr_predictor->update(pred, rec.taken, rec.ip, rec.target);
+        }
+    }
+
+    for (ras_it = ras_vec.begin(); ras_it != ras_vec.end(); ++ras_it) {
+        RASGroup *ras = *ras_it;
+        for (UINT32 i = 0; i < num_records; i++) {
+            const BranchRecord &rec = batch[i];
+            if (IsCallKind(rec.kind))
+                ras->push_addr(rec.ip + rec.size);
+            else if (rec.kind == BRANCH_RET)
+                ras->pop_addr(rec.target);
+            else if (rec.kind == BRANCH_COND)
+                ras->cond_branch(rec.ip, rec.taken);
+        }
+    }
+
+    for (ibp_it = indirect_predictors.begin(); ibp_it != indirect_predictors.end(); ++ibp_it) {
+        IndirectPredictor *curr_predictor = *ibp_it;
+        curr_predictor->accessBatch(batch, num_records);
+    }
+}
+
+/* ===================================================================== */
+
+inline VOID PrintStats(std::ostream &out, UINT64 total_instructions,
+                       std::vector<BranchPredictor *> &branch_predictors,
+                       std::vector<BTBPredictor *> &btb_predictors,
+                       std::vector<RASGroup *> &ras_vec,
+                       std::vector<IndirectPredictor *> &indirect_predictors)
+{
+    bp_iterator_t bp_it;
+    btb_iterator_t btb_it;
+    ras_vec_iterator_t ras_it;
+    ibp_iterator_t ibp_it;
+    std::vector<RAS *>::const_iterator r_it;
+
+    // Report total instructions and total cycles
+    out << "Total Instructions: " << total_instructions << "\n";
+    out << "\n";
+
+    out <<"RAS: (Correct - Incorrect)\n";
+    for (ras_it = ras_vec.begin(); ras_it != ras_vec.end(); ++ras_it)
+        for (r_it = (*ras_it)->getRAS().begin(); r_it != (*ras_it)->getRAS().end(); ++r_it)
+            out << (*r_it)->getNameAndStats() << "\n";
+    out << "\n";
+
+    out <<"Branch Predictors: (Name - Correct - Incorrect)\n";
+    for (bp_it = branch_predictors.begin(); bp_it != branch_predictors.end(); ++bp_it) {
+        BranchPredictor *curr_predictor = *bp_it;
+        out << "  " << curr_predictor->getName() << ": "
+            << curr_predictor->getNumCorrectPredictions() << " "
+            << curr_predictor->getNumIncorrectPredictions() << "\n";
+    }
+    out << "\n";
+
+    out <<"BTB Predictors: (Name - Correct - Incorrect - TargetCorrect)\n";
+    for (btb_it = btb_predictors.begin(); btb_it != btb_predictors.end(); ++btb_it) {
+        BTBPredictor *curr_predictor = *btb_it;
+        out << "  " << curr_predictor->getName() << ": "
+            << curr_predictor->getNumCorrectPredictions() << " "
+            << curr_predictor->getNumIncorrectPredictions() << " "
+            << curr_predictor->getNumCorrectTargetPredictions() << "\n";
+    }
+
+    //> Only printed when there are indirect predictors, so that the output of
+    //  the other sections stays the same
+    if (!indirect_predictors.empty()) {
+        out << "\n";
+        out << "Indirect Predictors: (Name - Correct - Incorrect - MPKI)\n";
+        for (ibp_it = indirect_predictors.begin(); ibp_it != indirect_predictors.end(); ++ibp_it) {
+            IndirectPredictor *curr_predictor = *ibp_it;
+            out << "  " << curr_predictor->getName() << ": "
+                << curr_predictor->getNumCorrectPredictions() << " "
+                << curr_predictor->getNumIncorrectPredictions() << " "
+                << (total_instructions ? curr_predictor->getNumIncorrectPredictions() * 1000.0
+                                         / total_instructions : 0.0) << "\n";
+        }
+    }
+
+    //> Only printed when there are loop overlays, as the indirect predictors
+    bool overlays = false;
+    for (bp_it = branch_predictors.begin(); bp_it != branch_predictors.end(); ++bp_it) {
+        UINT64 removed, added;
+        if (!(*bp_it)->getOverlayStats(removed, added))
+            continue;
+        if (!overlays) {
+            out << "\n";
+            out << "Loop Overlays: (Name - Removed - Added - Net MPKI)\n";
+            overlays = true;
+        }
+        out << "  " << (*bp_it)->getName() << ": " << removed << " " << added << " "
+            << (total_instructions ? ((double)removed - added) * 1000.0 / total_instructions : 0.0)
+            << "\n";
+    }
+
+    //> Breakdown of the RAS misses, kept apart from the RAS section so that
+    //  the scripts that parse "RAS" lines are not affected
+    if (!ras_vec.empty()) {
+        out << "\n";
+        out << "Return address stacks: (Entries - Overflows - Underflows - Mismatches)\n";
+        for (ras_it = ras_vec.begin(); ras_it != ras_vec.end(); ++ras_it)
+            for (r_it = (*ras_it)->getRAS().begin(); r_it != (*ras_it)->getRAS().end(); ++r_it)
+                out << "  " << (*r_it)->getNumEntries() << ": "
+                    << (*r_it)->getNumOverflows() << " "
+                    << (*r_it)->getNumUnderflows() << " "
+                    << (*r_it)->getNumMismatches() << "\n";
+    }
+}
+
+//> Returns the name of the function that contains ip, empty if unknown
+typedef string (*SymbolLookup)(ADDRINT ip);
+
+/**
+ * Lists the most mispredicted branches of every profiled predictor. The
+ * executions and the bias (fraction of taken executions) come from sketch.
+ * The mispredictions are the ones the profile is sure of (its count less
+ * its error), as estimated from its sample. A branch may have had up to
+ * "Max extra" more: the rest of the count. Both are capped by the
+ * executions.
+ **/
+inline VOID PrintProfiles(std::ostream &out,
+                          std::vector<BranchPredictor *> &branch_predictors,
+                          const BranchCountSketch &sketch, SymbolLookup lookup)
+{
+    bp_iterator_t bp_it;
+
+    for (bp_it = branch_predictors.begin(); bp_it != branch_predictors.end(); ++bp_it) {
+        BranchPredictor *curr_predictor = *bp_it;
+        BranchProfile *profile = curr_predictor->getProfile();
+        if (!profile)
+            continue;
+
+        std::vector<BranchProfile::Entry> top = profile->getTop();
+        out << curr_predictor->getName()
+            << ": (PC - Symbol - Executions - Mispredictions - Bias - Max extra)\n";
+        for (UINT32 i = 0; i < top.size(); i++) {
+            UINT64 executions = sketch.getExecutions(top[i].ip);
+            UINT64 at_most = std::min(top[i].mispredictions, executions);
+            UINT64 at_least = std::min(top[i].mispredictions - top[i].error, at_most);
+            string symbol = lookup ? lookup(top[i].ip) : "";
+            out << "  0x" << std::hex << top[i].ip << std::dec << " "
+                << (symbol.empty() ? "?" : symbol) << " "
+                << executions << " " << at_least << " "
+                << std::fixed << std::setprecision(3)
+                << (executions ? (double)sketch.getTaken(top[i].ip) / executions : 0.0)
+                << std::resetiosflags(std::ios::floatfield) << std::setprecision(6)
+                << " " << at_most - at_least << "\n";
+        }
+        out << "\n";
+    }
+}
+
+/* ===================================================================== */
+
+inline VOID InitPredictors(std::vector<BranchPredictor *> &branch_predictors)
+{
+    // N-bit predictors
+
+//    // 16K
+//    for (int i=1; i <= 4; i++) {
+//        NbitPredictor *nbitPred = new NbitPredictor(14, i);
+//        branch_predictors.push_back(nbitPred);
+//    }
+//
+//    NbitPredictor *nbitPred = new NbitPredictor(14, 2);
+//    branch_predictors.push_back(nbitPred);
+
+    // Alternative FSMs
+//    TwobitPredictor_FSM1 *nbitPredFSM1 = new TwobitPredictor_FSM1();
+//    branch_predictors.push_back(nbitPredFSM1);
+//    TwobitPredictor_FSM2 *nbitPredFSM2 = new TwobitPredictor_FSM2();
+//    branch_predictors.push_back(nbitPredFSM2);
+//    TwobitPredictor_FSM3 *nbitPredFSM3 = new TwobitPredictor_FSM3();
+//    branch_predictors.push_back(nbitPredFSM3);
+//    TwobitPredictor_FSM4 *nbitPredFSM4 = new TwobitPredictor_FSM4();
+//    branch_predictors.push_back(nbitPredFSM4);
+//    TwobitPredictor_FSM5 *nbitPredFSM5 = new TwobitPredictor_FSM5();
+//    branch_predictors.push_back(nbitPredFSM5);
+//
+//    // 32K hardware
+//    NbitPredictor *onebitPred = new NbitPredictor(15, 1);
+//    branch_predictors.push_back(onebitPred);
+//    NbitPredictor *fourbitPred = new NbitPredictor(13, 4);
+//    branch_predictors.push_back(fourbitPred);
+//    // Pentium-M predictor
+
+    //> The predictors with a fixed configuration are built from the
+    //  templates of predictor_engine.h, they give the same results as the
+    //  classes of branch_predictor.h without any virtual calls per branch.
+
+    // 1) Static AlwaysTaken
+    branch_predictors.push_back(new EnginePredictor<AlwaysTakenEngine>());
+
+    // 2) BTFNT
+    branch_predictors.push_back(new EnginePredictor<BTFNTEngine>());
+
+    // 3) n-bit predictor
+    branch_predictors.push_back(new EnginePredictor< NbitEngine<13, 4> >());
+    // 4) Pentium-M
+    branch_predictors.push_back(new PentiumMBranchPredictor());
+
+    // 5, 6, 7) Local History Two Level
+    branch_predictors.push_back(new EnginePredictor< LocalHistoryEngine<11, 8> >());
+    branch_predictors.push_back(new EnginePredictor< LocalHistoryEngine<12, 4> >());
+    branch_predictors.push_back(new EnginePredictor< LocalHistoryEngine<13, 2> >());
+
+    // 8, 9) Global History Two Level
+    branch_predictors.push_back(new EnginePredictor< GlobalHistoryEngine<14, 2> >());
+    branch_predictors.push_back(new EnginePredictor< GlobalHistoryEngine<13, 4> >());
+
+    // 10) Alpha21264
+    branch_predictors.push_back(new EnginePredictor<Alpha21264Engine>());
+
+    // 11, ..., 16) Tournament Hybrid Predictors
+    branch_predictors.push_back(new EnginePredictor< TournamentEngine<10,
+	NbitEngine<13, 2>, // 8K entries, 2bit predictor
+	NbitEngine<12, 4>  // 4K entries, 4bit predictor
+    > >());
+    branch_predictors.push_back(new EnginePredictor< TournamentEngine<11,
+	NbitEngine<13, 2>, // 8K entries, 2bit predictor
+	GlobalHistoryEngine<13, 2> // 8K entries, 2bit global history predictor
+    > >());
+    branch_predictors.push_back(new EnginePredictor< TournamentEngine<11,
+	NbitEngine<13, 2>, // 8K entries, 2bit predictor
+	LocalHistoryEngine<12, 2, 12, 2> // local history predictor, BHT and PHT:4K entries 2bit each
+    > >());
+    branch_predictors.push_back(new EnginePredictor< TournamentEngine<11,
+	LocalHistoryEngine<12, 2, 12, 2>,
+	GlobalHistoryEngine<13, 2>
+    > >());
+    branch_predictors.push_back(new EnginePredictor< TournamentEngine<11,
+	GlobalHistoryEngine<13, 2>,
+	GlobalHistoryEngine<12, 4> // 4K entries, 4bit global history predictor
+    > >());
+    branch_predictors.push_back(new EnginePredictor< TournamentEngine<11,
+	LocalHistoryEngine<12, 2, 12, 2>,
+	LocalHistoryEngine<11, 4, 12, 2> // local history predictor,BHT:2K entries,4bit,PHT:4K entries,2bit
+    > >());
+
+    // 17, 18) TAGE, 32 and 64 Kbit
+    branch_predictors.push_back(new TAGEPredictor(32));
+    branch_predictors.push_back(new TAGEPredictor(64));
+
+    // Perceptrons (build with -mavx2 for the AVX2 kernels)
+//    branch_predictors.push_back(new PerceptronPredictor(10, 32));
+//    branch_predictors.push_back(new HashedPerceptronPredictor(16, 10, 600));
+
+}
+
+inline VOID BTB(std::vector<BTBPredictor *> &btb_predictors)
+{
+    btb_predictors.push_back(new BTBPredictor(512, 1));
+    btb_predictors.push_back(new BTBPredictor(512, 2));
+    btb_predictors.push_back(new BTBPredictor(256, 2));
+    btb_predictors.push_back(new BTBPredictor(256, 4));
+    btb_predictors.push_back(new BTBPredictor(128, 2));
+    btb_predictors.push_back(new BTBPredictor(128, 4));
+    btb_predictors.push_back(new BTBPredictor(64, 4));
+    btb_predictors.push_back(new BTBPredictor(64, 8));
+}
+
+inline VOID InitIndirectPredictors(std::vector<IndirectPredictor *> &indirect_predictors)
+{
+    // PC indexed and path indexed iBTBs
+    indirect_predictors.push_back(new IBTBPredictor(9));
+    indirect_predictors.push_back(new IBTBPredictor(9, 9));
+    indirect_predictors.push_back(new PentiumMIndirectPredictor());
+
+    // ITTAGE with 6 tagged tables of 512 entries, histories of 4 to 128
+    indirect_predictors.push_back(new ITTAGEPredictor(6, 9, 11, 4, 128, 10));
+}
+
+//> Profiles the top num_entries mispredicted branches of every predictor
+inline VOID InitProfiles(std::vector<BranchPredictor *> &branch_predictors, UINT32 num_entries)
+{
+    bp_iterator_t bp_it;
+
+    for (bp_it = branch_predictors.begin(); bp_it != branch_predictors.end(); ++bp_it)
+        (*bp_it)->setProfile(new BranchProfile(num_entries));
+}
+
+//> All depths share one call/return stream, see RASGroup
+inline VOID InitRas(std::vector<RASGroup *> &ras_vec,
+                    RASRepair repair = RAS_NO_WRONG_PATH,
+                    UINT32 wrong_path_rets = 1, UINT32 wrong_path_calls = 1)
+{
+    RASGroup *group = new RASGroup();
+
+    for (UINT32 i = 4; i <= 64; i*=2) {
+        group->addRAS(i);
+        if (i == 32)
+            group->addRAS(48);
+    }
+    group->setRepair(repair, wrong_path_rets, wrong_path_calls);
+    ras_vec.push_back(group);
+}
+
+#endif
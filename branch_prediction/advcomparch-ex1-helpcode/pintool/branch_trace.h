@@ -0,0 +1,227 @@
+#ifndef BRANCH_TRACE_H
+#define BRANCH_TRACE_H
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/**
+ * Kinds of control flow instructions recorded in a branch trace.
+ * The classification follows InstrumentBranch() in branch_buffer.h:
+ * conditional branches go to the direction predictors, calls and returns
+ * go to the RAS, every jump and conditional branch goes to the BTBs and
+ * indirect jumps and calls go to the indirect target predictors.
+ **/
+enum BranchKind {
+    BRANCH_COND = 0, // conditional branch (XED_CATEGORY_COND_BR)
+    BRANCH_JUMP,     // any other direct branch that is not a call or a return
+    BRANCH_CALL,     // direct call
+    BRANCH_RET,
+    BRANCH_IND_JUMP, // jump through a register or memory
+    BRANCH_IND_CALL, // call through a register or memory
+    BRANCH_NUM_KINDS
+};
+
+//> Unconditional jumps of either kind, as the BTBs see them
+static inline bool IsJumpKind(UINT32 kind)
+{
+    return kind == BRANCH_JUMP || kind == BRANCH_IND_JUMP;
+}
+
+static inline bool IsCallKind(UINT32 kind)
+{
+    return kind == BRANCH_CALL || kind == BRANCH_IND_CALL;
+}
+
+static inline bool IsIndirectKind(UINT32 kind)
+{
+    return kind == BRANCH_IND_JUMP || kind == BRANCH_IND_CALL;
+}
+
+/**
+ * One dynamic branch as seen by the predictors.
+ **/
+struct BranchRecord {
+    ADDRINT ip;
+    ADDRINT target;
+    UINT64 icount; // instructions executed before this branch (only in trace files)
+    UINT32 kind;   // BranchKind
+    UINT32 size;   // instruction size, the return address of a call is ip + size
+    BOOL taken;
+    UINT32 epoch;  // sampling epoch of cslab_branch (see sampling.h), 0 otherwise
+};
+
+/**
+ * Trace file layout (all integers little endian):
+ *
+ *   BranchTraceHeader
+ *   block 0: BranchTraceBlock + encoded records, padded to 8 bytes
+ *   block 1: ...
+ *   index:   UINT64 file offset of every block
+ *   BranchTraceFooter
+ *
+ * Records are encoded relative to the previous record of the same block:
+ *   flags:  1 byte, bit 0 taken, bits 1-3 kind, bits 4-7 instruction size
+ *   ip:     zigzag varint of (ip - previous ip)
+ *   target: zigzag varint of (target - ip)
+ *   icount: varint of (icount - previous icount)
+ * The previous ip/icount start from 0 and the block's first_icount, so every
+ * block decodes on its own and a reader can start from any of them.
+ **/
+#define BRANCH_TRACE_MAGIC         "CSLBTRC"
+#define BRANCH_TRACE_VERSION       3
+// Version 2 traces have no indirect kinds and are otherwise the same
+#define BRANCH_TRACE_MIN_VERSION   2
+#define BRANCH_TRACE_BLOCK_RECORDS 65536
+#define BRANCH_TRACE_MAX_RECORD_BYTES (1 + 3 * 10)
+
+struct BranchTraceHeader {
+    char magic[8];
+    UINT32 version;
+    UINT32 block_records;
+};
+
+struct BranchTraceBlock {
+    UINT64 first_record;
+    UINT64 first_icount;
+    UINT32 num_records;
+    UINT32 num_bytes; // encoded records following this header
+};
+
+struct BranchTraceFooter {
+    UINT64 index_offset;
+    UINT64 num_blocks;
+    UINT64 num_records;
+    UINT64 total_instructions;
+    char magic[8];
+};
+
+static inline unsigned char *EncodeVarint(unsigned char *p, UINT64 v)
+{
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static inline const unsigned char *DecodeVarint(const unsigned char *p, UINT64 &v)
+{
+    UINT64 result = 0;
+    unsigned shift = 0;
+
+    while (*p & 0x80) {
+        result |= (UINT64)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    v = result | ((UINT64)*p++ << shift);
+    return p;
+}
+
+static inline UINT64 ZigZagEncode(INT64 v) { return ((UINT64)v << 1) ^ (UINT64)(v >> 63); }
+static inline INT64 ZigZagDecode(UINT64 v) { return (INT64)(v >> 1) ^ -(INT64)(v & 1); }
+
+class BranchTraceWriter
+{
+public:
+    BranchTraceWriter()
+        : fp(NULL), num_records(0), block_start(0), prev_ip(0), prev_icount(0),
+          buf(BRANCH_TRACE_BLOCK_RECORDS * BRANCH_TRACE_MAX_RECORD_BYTES), buf_pos(0) {
+        memset(&block, 0, sizeof(block));
+    };
+    ~BranchTraceWriter() { if (fp) fclose(fp); };
+
+    bool open(const char *path) {
+        BranchTraceHeader hdr;
+
+        fp = fopen(path, "wb");
+        if (!fp)
+            return false;
+
+        memset(&hdr, 0, sizeof(hdr));
+        strncpy(hdr.magic, BRANCH_TRACE_MAGIC, sizeof(hdr.magic));
+        hdr.version = BRANCH_TRACE_VERSION;
+        hdr.block_records = BRANCH_TRACE_BLOCK_RECORDS;
+        block_start = sizeof(hdr);
+        return fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    }
+
+    void write(const BranchRecord &rec) {
+        unsigned char *p = &buf[buf_pos];
+
+        if (block.num_records == 0) {
+            block.first_record = num_records;
+            block.first_icount = rec.icount;
+            prev_ip = 0;
+            prev_icount = rec.icount;
+        }
+
+        *p++ = (unsigned char)((rec.taken ? 1 : 0) | (rec.kind << 1) | ((rec.size & 0xf) << 4));
+        p = EncodeVarint(p, ZigZagEncode((INT64)(rec.ip - prev_ip)));
+        p = EncodeVarint(p, ZigZagEncode((INT64)(rec.target - rec.ip)));
+        p = EncodeVarint(p, rec.icount - prev_icount);
+        buf_pos = p - &buf[0];
+
+        prev_ip = rec.ip;
+        prev_icount = rec.icount;
+        num_records++;
+        if (++block.num_records == BRANCH_TRACE_BLOCK_RECORDS)
+            flushBlock();
+    }
+
+    void close(UINT64 total_instructions) {
+        BranchTraceFooter footer;
+
+        if (!fp)
+            return;
+        flushBlock();
+
+        memset(&footer, 0, sizeof(footer));
+        footer.index_offset = block_start;
+        footer.num_blocks = index.size();
+        footer.num_records = num_records;
+        footer.total_instructions = total_instructions;
+        strncpy(footer.magic, BRANCH_TRACE_MAGIC, sizeof(footer.magic));
+        if (!index.empty())
+            fwrite(&index[0], sizeof(index[0]), index.size(), fp);
+        fwrite(&footer, sizeof(footer), 1, fp);
+        fclose(fp);
+        fp = NULL;
+    }
+
+    UINT64 getNumRecords() { return num_records; }
+
+private:
+    void flushBlock() {
+        static const unsigned char zeros[8] = { 0 };
+        size_t padding = (8 - buf_pos % 8) % 8;
+
+        if (block.num_records == 0)
+            return;
+        block.num_bytes = buf_pos;
+        fwrite(&block, sizeof(block), 1, fp);
+        fwrite(&buf[0], 1, buf_pos, fp);
+        // Keep the next block header 8-byte aligned in the mapped file
+        fwrite(zeros, 1, padding, fp);
+
+        index.push_back(block_start);
+        block_start += sizeof(block) + buf_pos + padding;
+        block.num_records = 0;
+        buf_pos = 0;
+    }
+
+    FILE *fp;
+    UINT64 num_records;
+
+    BranchTraceBlock block;
+    UINT64 block_start; // file offset of the block being filled
+    ADDRINT prev_ip;
+    UINT64 prev_icount;
+    std::vector<unsigned char> buf;
+    size_t buf_pos;
+
+    std::vector<UINT64> index;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef BRANCH_TRACE_READER_H
+#define BRANCH_TRACE_READER_H
+
+/**
+ * Memory mapped reader for the branch traces written by BranchTraceWriter.
+ * Uses POSIX mmap, so it is only meant for the Pin-free tools (bp_replay).
+ **/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sstream>
+
+#include "branch_trace.h"
+
+class BranchTraceReader
+{
+public:
+    /**
+     * Forward iterator over the records of a trace. The records are decoded
+     * straight out of the mapped file into the iterator, nothing is copied
+     * or buffered on the way.
+     **/
+    class iterator
+    {
+    public:
+        iterator() : reader(NULL), block_idx(0), left(0), pos(NULL) {}
+
+        const BranchRecord &operator*() const { return rec; }
+        const BranchRecord *operator->() const { return &rec; }
+
+        iterator &operator++() {
+            if (left == 0)
+                enterBlock(block_idx + 1);
+            else
+                decode();
+            return *this;
+        }
+
+        bool operator==(const iterator &o) const {
+            return block_idx == o.block_idx && left == o.left;
+        }
+        bool operator!=(const iterator &o) const { return !(*this == o); }
+
+    private:
+        friend class BranchTraceReader;
+
+        iterator(const BranchTraceReader *reader_, UINT64 block_idx_)
+            : reader(reader_), left(0), pos(NULL) { enterBlock(block_idx_); }
+
+        // Position on the first record of the given block (or at the end)
+        void enterBlock(UINT64 idx) {
+            const BranchTraceBlock *block;
+
+            block_idx = idx;
+            if (block_idx >= reader->num_blocks) {
+                block_idx = reader->num_blocks;
+                left = 0;
+                return;
+            }
+            block = reader->getBlock(block_idx);
+            pos = (const unsigned char *)(block + 1);
+            left = block->num_records;
+            rec.ip = 0;
+            rec.icount = block->first_icount;
+            rec.epoch = 0;
+            decode();
+        }
+
+        void decode() {
+            UINT64 v;
+            unsigned char flags = *pos++;
+
+            rec.taken = flags & 1;
+            rec.kind = (flags >> 1) & 0x7;
+            rec.size = flags >> 4;
+            pos = DecodeVarint(pos, v);
+            rec.ip += ZigZagDecode(v);
+            pos = DecodeVarint(pos, v);
+            rec.target = rec.ip + ZigZagDecode(v);
+            pos = DecodeVarint(pos, v);
+            rec.icount += v;
+            left--;
+        }
+
+        const BranchTraceReader *reader;
+        UINT64 block_idx;
+        UINT32 left; // records of the current block after rec
+        const unsigned char *pos;
+        BranchRecord rec;
+    };
+
+    BranchTraceReader() : base(NULL), length(0), index(NULL), num_blocks(0) {
+        memset(&footer, 0, sizeof(footer));
+    };
+    ~BranchTraceReader() { if (base) munmap((void *)base, length); };
+
+    bool open(const char *path) {
+        const BranchTraceHeader *hdr;
+        struct stat st;
+        void *map;
+        int fd;
+
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return fail("cannot open the file");
+        if (fstat(fd, &st) < 0 ||
+            (size_t)st.st_size < sizeof(BranchTraceHeader) + sizeof(BranchTraceFooter)) {
+            ::close(fd);
+            return fail("too short for a branch trace");
+        }
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return fail("cannot map the file");
+        base = (const unsigned char *)map;
+        length = st.st_size;
+        madvise(map, length, MADV_SEQUENTIAL);
+
+        hdr = (const BranchTraceHeader *)base;
+        if (strncmp(hdr->magic, BRANCH_TRACE_MAGIC, sizeof(hdr->magic)) != 0 ||
+            hdr->version < BRANCH_TRACE_MIN_VERSION || hdr->version > BRANCH_TRACE_VERSION)
+            return fail("not a branch trace of a supported version");
+
+        memcpy(&footer, base + length - sizeof(footer), sizeof(footer));
+        if (strncmp(footer.magic, BRANCH_TRACE_MAGIC, sizeof(footer.magic)) != 0 ||
+            footer.num_blocks > length / sizeof(UINT64) || footer.index_offset % sizeof(UINT64) ||
+            footer.index_offset + footer.num_blocks * sizeof(UINT64) + sizeof(footer) != length)
+            return fail("truncated, or the footer is corrupt");
+        index = (const UINT64 *)(base + footer.index_offset);
+        num_blocks = footer.num_blocks;
+        return checkIndex();
+    }
+
+    //> Why the last open() failed
+    const string &getError() const { return error; }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, num_blocks); }
+
+    /**
+     * Returns an iterator to the first record with icount >= the given
+     * instruction count. The block is found with a binary search over the
+     * index, so only that block has to be decoded.
+     **/
+    iterator seek(UINT64 icount) const {
+        UINT64 lo = 0, hi = num_blocks;
+
+        // Last block whose first record starts at or before icount
+        while (hi - lo > 1) {
+            UINT64 mid = lo + (hi - lo) / 2;
+            if (getBlock(mid)->first_icount <= icount)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        iterator it(this, lo);
+        while (it != end() && it->icount < icount)
+            ++it;
+        return it;
+    }
+
+    UINT64 getNumRecords() const { return footer.num_records; }
+    UINT64 getTotalInstructions() const { return footer.total_instructions; }
+
+private:
+    const BranchTraceBlock *getBlock(UINT64 idx) const {
+        return (const BranchTraceBlock *)(base + index[idx]);
+    }
+
+    //> Every block of the index must lie between the header and the index
+    //  and hold as many bytes as its records need, so that seek() and the
+    //  iterators never read past the mapping
+    bool checkIndex() {
+        UINT64 records = 0;
+
+        for (UINT64 i = 0; i < num_blocks; i++) {
+            std::ostringstream stream;
+            const BranchTraceBlock *block;
+
+            stream << "block " << i << " of " << num_blocks;
+            if (index[i] < sizeof(BranchTraceHeader) || index[i] % sizeof(UINT64) ||
+                index[i] + sizeof(BranchTraceBlock) > footer.index_offset)
+                return fail(stream.str() + " starts outside the records");
+            block = getBlock(i);
+            if (block->num_records == 0 ||
+                block->num_records > ((const BranchTraceHeader *)base)->block_records ||
+                (UINT64)block->num_records * 4 > block->num_bytes ||
+                (UINT64)block->num_records * BRANCH_TRACE_MAX_RECORD_BYTES < block->num_bytes)
+                return fail(stream.str() + " has a bad record count");
+            if (index[i] + sizeof(BranchTraceBlock) + block->num_bytes > footer.index_offset)
+                return fail(stream.str() + " runs past the end of the records");
+            records += block->num_records;
+        }
+        if (records != footer.num_records)
+            return fail("the blocks do not hold the records of the footer");
+        return true;
+    }
+
+    bool fail(const string &what) {
+        error = what;
+        return false;
+    }
+
+    const unsigned char *base;
+    size_t length;
+    BranchTraceFooter footer;
+    const UINT64 *index;
+    UINT64 num_blocks;
+    string error;
+};
+
+#endif
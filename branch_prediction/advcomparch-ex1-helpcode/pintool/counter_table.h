@@ -0,0 +1,90 @@
+#ifndef COUNTER_TABLE_H
+#define COUNTER_TABLE_H
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "state_archive.h"
+
+//> Bits needed to tell n things apart, 0 for n <= 1
+inline unsigned CeilLog2(UINT64 n)
+{
+    unsigned bits = 0;
+    while (bits < 64 && (1ULL << bits) < n)
+        bits++;
+    return bits;
+}
+
+/**
+ * A table of 1 to 8 bit saturating counters packed into 64-bit words.
+ * Every counter gets a slot of 1, 2, 4 or 8 bits (the width rounded up to a
+ * power of two), so a counter never straddles two words and a 16K-entry
+ * table of 2-bit counters takes 4 KB.
+ *
+ * Bits is the counter width, or 0 when the width is only known at run time
+ * (NbitPredictor); the fixed width versions let the compiler fold all the
+ * shifts and masks.
+ **/
+template <unsigned Bits = 0>
+class PackedCounterTable
+{
+public:
+    PackedCounterTable(unsigned index_bits, unsigned cntr_bits = Bits)
+        : cntr_bits(Bits ? Bits : cntr_bits), slot_shift(SlotShift(Bits ? Bits : cntr_bits)),
+          counter_max((1u << (Bits ? Bits : cntr_bits)) - 1), entries(1u << index_bits) {
+        assert(this->cntr_bits >= 1 && this->cntr_bits <= 8);
+        words.resize(((UINT64)entries << slotShift()) / 64 + 1, 0);
+    };
+
+    unsigned size() const { return entries; }
+    unsigned counterBits() const { return Bits ? Bits : cntr_bits; }
+    unsigned counterMax() const { return Bits ? (1u << Bits) - 1 : counter_max; }
+
+    unsigned get(unsigned index) const {
+        unsigned pos = index << slotShift();
+        return (unsigned)(words[pos / 64] >> (pos % 64)) & counterMax();
+    }
+
+    void set(unsigned index, unsigned value) {
+        unsigned pos = index << slotShift();
+        UINT64 &word = words[pos / 64];
+        word = (word & ~((UINT64)counterMax() << (pos % 64))) | ((UINT64)value << (pos % 64));
+    }
+
+    //> Most significant bit of the counter
+    bool predict(unsigned index) const {
+        return (get(index) >> (counterBits() - 1)) != 0;
+    }
+
+    //> Saturating increment when taken, decrement when not, without branches
+    void update(unsigned index, bool taken) {
+        unsigned pos = index << slotShift();
+        UINT64 &word = words[pos / 64];
+        unsigned c = (unsigned)(word >> (pos % 64)) & counterMax();
+        unsigned up = taken & (c < counterMax());
+        unsigned down = !taken & (c > 0);
+        // c + up - down never leaves [0, max], so the other slots are untouched
+        word += ((UINT64)up << (pos % 64)) - ((UINT64)down << (pos % 64));
+    }
+
+    //> Host memory taken by the counters
+    UINT64 getSizeBytes() const { return words.size() * sizeof(UINT64); }
+
+    //> The counters, the geometry comes from the constructor
+    void serialize(StateArchive &ar) { ar.io(words); }
+
+private:
+    static unsigned SlotShift(unsigned bits) {
+        return bits <= 1 ? 0 : bits <= 2 ? 1 : bits <= 4 ? 2 : 3;
+    }
+    unsigned slotShift() const {
+        return Bits ? (Bits <= 1 ? 0 : Bits <= 2 ? 1 : Bits <= 4 ? 2 : 3) : slot_shift;
+    }
+
+    unsigned cntr_bits, slot_shift, counter_max;
+    unsigned entries;
+    std::vector<UINT64> words;
+};
+
+#endif
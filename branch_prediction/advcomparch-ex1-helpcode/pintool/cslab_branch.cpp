@@ -6,34 +6,141 @@
 
 using namespace std;
 
-#include "branch_predictor.h"
-#include "pentium_m_predictor/pentium_m_branch_predictor.h"
-#include "ras.h"
+#include "branch_sim.h"
+#include "predictor_spec.h"
+#include "branch_buffer.h"
+#include "interval_stats.h"
+#include "sampling.h"
+#include "thread_data.h"
+#include "predictor_snapshot.h"
+#include "timing_model.h"
+#include "storage_report.h"
 
 /* ===================================================================== */
 /* Commandline Switches                                                  */
 /* ===================================================================== */
 KNOB<string> KnobOutputFile(KNOB_MODE_WRITEONCE,    "pintool",
     "o", "cslab_branch.out", "specify output file name");
+KNOB<UINT32> KnobThreads(KNOB_MODE_WRITEONCE,    "pintool",
+    "threads", "0", "worker threads that evaluate the predictors (0 evaluates them on the application thread)");
+KNOB<UINT32> KnobBatchSize(KNOB_MODE_WRITEONCE,    "pintool",
+    "batch", "16384", "branches buffered before they are handed to the predictors");
+KNOB<string> KnobSpec(KNOB_MODE_APPEND,    "pintool",
+    "spec", "", "predictors to simulate, e.g. nbit(10..16, 2); btb(512, 2) (see predictor_spec.h)");
+KNOB<string> KnobSpecFile(KNOB_MODE_APPEND,    "pintool",
+    "spec_file", "", "file with predictor specs, one per line");
+KNOB<UINT32> KnobProfile(KNOB_MODE_WRITEONCE,    "pintool",
+    "profile", "0", "report the N most mispredicted branches of every predictor (0 disables the profile)");
+KNOB<string> KnobProfileFile(KNOB_MODE_WRITEONCE,    "pintool",
+    "profile_file", "cslab_branch.profile", "specify the profile output file name");
+KNOB<UINT64> KnobInterval(KNOB_MODE_WRITEONCE,    "pintool",
+    "interval", "0", "write the predictor counters of every N instructions (0 disables the time series)");
+KNOB<string> KnobIntervalFile(KNOB_MODE_WRITEONCE,    "pintool",
+    "interval_file", "cslab_branch.intervals.csv", "specify the time series output file name");
+KNOB<UINT64> KnobFastForward(KNOB_MODE_WRITEONCE,    "pintool",
+    "ffwd", "0", "sampling: instructions only counted before every window");
+KNOB<UINT64> KnobWarmup(KNOB_MODE_WRITEONCE,    "pintool",
+    "warmup", "0", "sampling: instructions that train the predictors before every detail window");
+KNOB<UINT64> KnobDetail(KNOB_MODE_WRITEONCE,    "pintool",
+    "detail", "0", "sampling: instructions measured in every window (0 simulates the whole run)");
+KNOB<string> KnobSimPoints(KNOB_MODE_WRITEONCE,    "pintool",
+    "simpoints", "", "sampling: file with the instruction offset and weight of every detail window, instead of -ffwd");
+KNOB<string> KnobThreadMode(KNOB_MODE_WRITEONCE,    "pintool",
+    "thread_mode", "shared", "shared: all threads drive one set of predictors, as SMT threads of a core do, "
+    "interleaved every -batch branches; private: every thread has its own predictors, merged at the end");
+KNOB<string> KnobRasRepair(KNOB_MODE_WRITEONCE,    "pintool",
+    "ras_repair", "off", "RAS wrong path model: off, none, tos or tos+top, optionally followed by :rets,calls of the wrong path");
+KNOB<string> KnobTiming(KNOB_MODE_WRITEONCE,    "pintool",
+    "timing", "", "report cycles and IPC with a front-end timing model, given as cpi,direction,btb,ras[,indirect] "
+    "(the base CPI and the miss penalties in cycles, see timing_model.h)");
+KNOB<BOOL> KnobStorage(KNOB_MODE_WRITEONCE,    "pintool",
+    "storage", "0", "report the storage in bits of every predictor and the MPKI-vs-storage Pareto frontier");
+KNOB<string> KnobLoadState(KNOB_MODE_WRITEONCE,    "pintool",
+    "load_state", "", "warm up the predictors with the state of a snapshot (see predictor_snapshot.h)");
+KNOB<string> KnobSaveState(KNOB_MODE_WRITEONCE,    "pintool",
+    "save_state", "", "save the state of the predictors to a snapshot at the end");
+KNOB<UINT64> KnobCheckpoint(KNOB_MODE_WRITEONCE,    "pintool",
+    "checkpoint", "0", "also save the -save_state snapshot every N instructions (0 only saves it at the end)");
 /* ===================================================================== */
 
 /* ===================================================================== */
 /* Global Variables                                                      */
 /* ===================================================================== */
 std::vector<BranchPredictor *> branch_predictors;
-typedef std::vector<BranchPredictor *>::iterator bp_iterator_t;
 
 //> BTBs have slightly different interface (they also have target predictions)
 //  so we need to have different vector for them.
 std::vector<BTBPredictor *> btb_predictors;
-typedef std::vector<BTBPredictor *>::iterator btb_iterator_t;
 
-std::vector<RAS *> ras_vec;
-typedef std::vector<RAS *>::iterator ras_vec_iterator_t;
+std::vector<RASGroup *> ras_vec;
+
+//> Indirect jumps and calls get their own target predictors
+std::vector<IndirectPredictor *> indirect_predictors;
+
+//> Executions and taken counts of the profiled branches, NULL without -profile
+BranchCountSketch *branch_sketch;
+
+//> Per-interval counters, NULL without -interval
+IntervalStats *interval_stats;
+std::ofstream intervalFile;
+
+//> Sampled simulation, NULL when the whole run is simulated. The schedule
+//  moves on in SwitchPhase() and the records carry the epoch they were
+//  recorded in, so BufferFull() catches up with it record by record.
+SampleSchedule *sample_schedule;
+SampleStats *sample_stats;
+UINT32 sample_epoch;                       // epoch of the last simulated record
+UINT64 detail_start;                       // instruction count of the current detail window
+std::vector<UINT64> window_instructions;   // length of every finished detail window
+
+//> Instruction counts and, with -thread_mode private, the predictors of
+//  every application thread
+struct ThreadData {
+    UINT64 instructions;
+    std::vector<BranchPredictor *> branch_predictors;
+    std::vector<BTBPredictor *> btb_predictors;
+    std::vector<RASGroup *> ras_vec;
+    std::vector<IndirectPredictor *> indirect_predictors;
+};
+ThreadDataRegistry<ThreadData> thread_data;
+BOOL private_predictors;
+
+//> Snapshot of -load_state, NULL without it. Kept for the private
+//  predictors of the threads that start later.
+PredictorSnapshot *warm_snapshot;
+UINT64 next_checkpoint = ~0ULL;
+
+//> Cycles and IPC in the output, NULL without -timing
+TimingModel *timing_model;
+
+//> Predictors to build, from the knobs
+string predictor_specs;
+RASRepair ras_repair = RAS_NO_WRONG_PATH;
+UINT32 wrong_path_rets = 1, wrong_path_calls = 1;
 
-UINT64 total_instructions;
 std::ofstream outFile;
 
+//> Branches are recorded into a per-thread Pin buffer and the predictors
+//  run over a whole buffer at a time from BufferFull().
+BUFFER_ID branch_buffer;
+PIN_LOCK predictors_lock;
+
+//> With -threads N the predictors are split among N worker threads that
+//  evaluate each full buffer in parallel.
+struct PredictorWorker {
+    std::vector<BranchPredictor *> branch_predictors;
+    std::vector<BTBPredictor *> btb_predictors;
+    std::vector<RASGroup *> ras_vec;
+    std::vector<IndirectPredictor *> indirect_predictors;
+    PIN_SEMAPHORE batch_ready, batch_done;
+    PIN_THREAD_UID uid;
+};
+std::vector<PredictorWorker *> workers;
+
+const BranchRecord *work_batch;
+UINT32 work_batch_size;
+volatile BOOL workers_exit;
+
 /* ===================================================================== */
 
 INT32 Usage()
@@ -46,227 +153,444 @@ INT32 Usage()
 
 /* ===================================================================== */
 
-VOID count_instruction()
+VOID count_instruction(ThreadData *td)
+{
+    td->instructions++;
+}
+
+VOID PIN_FAST_ANALYSIS_CALL count_bbl_instructions(ThreadData *td, UINT32 num_ins)
+{
+    td->instructions += num_ins;
+}
+
+//> Instructions of all threads, exact once they have all exited
+UINT64 TotalInstructions()
 {
-    total_instructions++;
+    return thread_data.sum(&ThreadData::instructions);
 }
 
-VOID call_instruction(ADDRINT ip, ADDRINT target, UINT32 ins_size)
+//> Counting while sampling, true once the next phase is due. The phases
+//  follow the count of the thread that gets to the boundary first.
+ADDRINT PIN_FAST_ANALYSIS_CALL count_and_check(ThreadData *td, UINT32 num_ins)
 {
-    ras_vec_iterator_t ras_it;
+    td->instructions += num_ins;
+    return td->instructions >= sample_schedule->getNextSwitch();
+}
 
-    for (ras_it = ras_vec.begin(); ras_it != ras_vec.end(); ++ras_it) {
-        RAS *ras = *ras_it;
-        ras->push_addr(ip + ins_size);
+/**
+ * Moves the schedule to the phase the instruction count is in and redoes
+ * the instrumentation for it. The block (or REP instruction) that crossed
+ * the boundary runs again from its start in the new code, so its
+ * instructions are taken back out of the count first.
+ **/
+VOID SwitchPhase(CONTEXT *ctxt, ThreadData *td, UINT32 num_ins, THREADID tid)
+{
+    PIN_GetLock(&predictors_lock, tid + 1);
+    while (td->instructions >= sample_schedule->getNextSwitch()) {
+        if (sample_schedule->getPhase() == SAMPLE_DETAIL)
+            window_instructions.push_back(td->instructions - detail_start);
+        sample_schedule->advance(td->instructions);
+        if (sample_schedule->getPhase() == SAMPLE_DETAIL)
+            detail_start = td->instructions;
     }
+    td->instructions -= num_ins;
+    PIN_ReleaseLock(&predictors_lock);
+
+    PIN_RemoveInstrumentation();
+    PIN_ExecuteAt(ctxt);
 }
 
-VOID ret_instruction(ADDRINT ip, ADDRINT target)
+/* ===================================================================== */
+
+VOID WorkerThread(VOID *arg)
 {
-    ras_vec_iterator_t ras_it;
+    PredictorWorker *worker = (PredictorWorker *)arg;
+
+    while (1) {
+        PIN_SemaphoreWait(&worker->batch_ready);
+        PIN_SemaphoreClear(&worker->batch_ready);
+        if (workers_exit)
+            break;
 
-    for (ras_it = ras_vec.begin(); ras_it != ras_vec.end(); ++ras_it) {
-        RAS *ras = *ras_it;
-        ras->pop_addr(target);
+        SimulateBatch(worker->branch_predictors, worker->btb_predictors, worker->ras_vec,
+                      worker->indirect_predictors, work_batch, work_batch_size);
+        PIN_SemaphoreSet(&worker->batch_done);
     }
 }
 
-VOID cond_branch_instruction(ADDRINT ip, ADDRINT target, BOOL taken)
+VOID WaitForWorkers()
 {
-    bp_iterator_t bp_it;
-    BOOL pred;
+    std::vector<PredictorWorker *>::iterator w_it;
 
-    for (bp_it = branch_predictors.begin(); bp_it != branch_predictors.end(); ++bp_it) {
-        BranchPredictor *curr_predictor = *bp_it;
-        pred = curr_predictor->predict(ip, target);
-        curr_predictor->update(pred, taken, ip, target);
+    for (w_it = workers.begin(); w_it != workers.end(); ++w_it)
+        PIN_SemaphoreWait(&(*w_it)->batch_done);
+}
+
+/**
+ * Evaluates a full buffer on the workers. The buffer belongs to the
+ * application thread and Pin may release it once BufferFull() returns, so
+ * this waits until all workers are done with it.
+ **/
+VOID DispatchBatch(const BranchRecord *batch, UINT32 num_records)
+{
+    std::vector<PredictorWorker *>::iterator w_it;
+
+    work_batch = batch;
+    work_batch_size = num_records;
+    for (w_it = workers.begin(); w_it != workers.end(); ++w_it) {
+        PIN_SemaphoreClear(&(*w_it)->batch_done);
+        PIN_SemaphoreSet(&(*w_it)->batch_ready);
     }
+
+    WaitForWorkers();
 }
 
-VOID branch_instruction(ADDRINT ip, ADDRINT target, BOOL taken)
+VOID SimulateRecords(const BranchRecord *batch, UINT32 num_records)
 {
-    btb_iterator_t btb_it;
-    BOOL pred;
+    if (branch_sketch)
+        branch_sketch->addBatch(batch, num_records);
+    // Once the workers are stopped (the final flush of each thread) all
+    // predictors are evaluated here
+    if (workers.empty() || workers_exit)
+        SimulateBatch(branch_predictors, btb_predictors, ras_vec, indirect_predictors,
+                      batch, num_records);
+    else
+        DispatchBatch(batch, num_records);
+}
 
-    for (btb_it = btb_predictors.begin(); btb_it != btb_predictors.end(); ++btb_it) {
-        BTBPredictor *curr_predictor = *btb_it;
-        pred = curr_predictor->predict(ip, target);
-        curr_predictor->update(pred, taken, ip, target);
+//> Opens and closes the detail windows between the last simulated epoch and epoch
+VOID CatchUpEpoch(UINT32 epoch)
+{
+    for (; sample_epoch < epoch; sample_epoch++) {
+        UINT32 window = WindowOfEpoch(sample_epoch);
+        if (PhaseOfEpoch(sample_epoch) == SAMPLE_DETAIL)
+            sample_stats->endWindow(window_instructions[window],
+                                    sample_schedule->getWeight(window));
+        if (PhaseOfEpoch(sample_epoch + 1) == SAMPLE_DETAIL)
+            sample_stats->beginWindow();
     }
 }
 
-VOID Instruction(INS ins, void * v)
+//> Writes the -save_state snapshot, taken at instruction count icount
+VOID SaveState(UINT64 icount)
+{
+    PredictorSnapshot snapshot;
+    string error;
+
+    snapshot.capture(branch_predictors, btb_predictors, ras_vec, indirect_predictors,
+                     icount, icount);
+    if (!snapshot.write(KnobSaveState.Value(), error))
+        cerr << "Cannot save the predictor state: " << error << "\n";
+}
+
+VOID *BufferFull(BUFFER_ID id, THREADID tid, const CONTEXT *ctxt, VOID *buf,
+                 UINT64 num_elements, VOID *v)
+{
+    const BranchRecord *batch = (const BranchRecord *)buf;
+
+    // Private predictors are only ever touched by their own thread
+    if (private_predictors) {
+        ThreadData *td = thread_data.get(tid);
+        SimulateBatch(td->branch_predictors, td->btb_predictors, td->ras_vec,
+                      td->indirect_predictors, batch, num_elements);
+        return buf;
+    }
+
+    PIN_GetLock(&predictors_lock, tid + 1);
+    if (!sample_schedule) {
+        SimulateRecords(batch, num_elements);
+    } else {
+        // Simulate the records of every epoch apart, so that the windows
+        // start and end on the exact branch
+        UINT32 first = 0;
+        while (first < num_elements) {
+            UINT32 last = first + 1;
+            while (last < num_elements && batch[last].epoch == batch[first].epoch)
+                last++;
+            CatchUpEpoch(batch[first].epoch);
+            SimulateRecords(batch + first, last - first);
+            first = last;
+        }
+    }
+    // Interval boundaries are only checked here, once per buffer, so the
+    // instruction counting stays as it is. An interval ends at the first
+    // buffer after its boundary and its row carries the actual count.
+    if (interval_stats) {
+        UINT64 total_instructions = TotalInstructions();
+        if (total_instructions >= interval_stats->getNextBoundary())
+            interval_stats->sample(total_instructions);
+    }
+    // Checkpoints too, the workers are done with the buffer by now
+    if (next_checkpoint != ~0ULL) {
+        UINT64 total_instructions = TotalInstructions();
+        if (total_instructions >= next_checkpoint) {
+            SaveState(total_instructions);
+            while (next_checkpoint <= total_instructions)
+                next_checkpoint += KnobCheckpoint.Value();
+        }
+    }
+    PIN_ReleaseLock(&predictors_lock);
+
+    return buf;
+}
+
+VOID InitWorkers(UINT32 num_workers)
 {
-    if (INS_Category(ins) == XED_CATEGORY_COND_BR)
-        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)cond_branch_instruction,
-                       IARG_INST_PTR, IARG_BRANCH_TARGET_ADDR, IARG_BRANCH_TAKEN,
-                       IARG_END);
-    else if (INS_IsCall(ins))
-        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)call_instruction,
-                       IARG_INST_PTR, IARG_BRANCH_TARGET_ADDR,
-                       IARG_UINT32, INS_Size(ins), IARG_END);
-    else if (INS_IsRet(ins))
-        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)ret_instruction,
-                       IARG_INST_PTR, IARG_BRANCH_TARGET_ADDR, IARG_END);
-
-    // For BTB we instrument all branches except returns
-    if (INS_IsBranch(ins) && !INS_IsRet(ins))
-    INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)branch_instruction,
-                   IARG_INST_PTR, IARG_BRANCH_TARGET_ADDR, IARG_BRANCH_TAKEN,
-                   IARG_END);
-
-    // Count each and every instruction
-    INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)count_instruction, IARG_END);
+    UINT32 next = 0;
+
+    for (UINT32 i = 0; i < num_workers; i++) {
+        PredictorWorker *worker = new PredictorWorker();
+        PIN_SemaphoreInit(&worker->batch_ready);
+        PIN_SemaphoreInit(&worker->batch_done);
+        PIN_SemaphoreSet(&worker->batch_done);
+        workers.push_back(worker);
+    }
+
+    // Deal the predictors round robin, each one is owned by a single worker
+    for (UINT32 i = 0; i < branch_predictors.size(); i++)
+        workers[next++ % num_workers]->branch_predictors.push_back(branch_predictors[i]);
+    for (UINT32 i = 0; i < btb_predictors.size(); i++)
+        workers[next++ % num_workers]->btb_predictors.push_back(btb_predictors[i]);
+    for (UINT32 i = 0; i < ras_vec.size(); i++)
+        workers[next++ % num_workers]->ras_vec.push_back(ras_vec[i]);
+    for (UINT32 i = 0; i < indirect_predictors.size(); i++)
+        workers[next++ % num_workers]->indirect_predictors.push_back(indirect_predictors[i]);
+
+    for (UINT32 i = 0; i < num_workers; i++)
+        PIN_SpawnInternalThread(WorkerThread, workers[i], 0, &workers[i]->uid);
 }
 
 /* ===================================================================== */
 
-VOID Fini(int code, VOID * v)
+VOID Instruction(INS ins, void * v)
 {
-    bp_iterator_t bp_it;
-    btb_iterator_t btb_it;
-    ras_vec_iterator_t ras_it;
+    if (!sample_schedule)
+        InstrumentBranch(ins, branch_buffer);
+    else if (sample_schedule->getPhase() != SAMPLE_FFWD)
+        InstrumentBranch(ins, branch_buffer, sample_schedule->getEpoch());
+}
 
-    // Report total instructions and total cycles
-    outFile << "Total Instructions: " << total_instructions << "\n";
-    outFile << "\n";
+//> Instruction counting of the sampled runs, which also ends the phases
+VOID InstrumentSampledCount(TRACE trace)
+{
+    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        UINT32 num_ins = 0;
+        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+            if (INS_HasRealRep(ins)) {
+                INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR)count_and_check,
+                                 IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE, thread_data.getReg(),
+                                 IARG_UINT32, 1, IARG_END);
+                INS_InsertThenCall(ins, IPOINT_BEFORE, (AFUNPTR)SwitchPhase,
+                                   IARG_CONTEXT, IARG_REG_VALUE, thread_data.getReg(),
+                                   IARG_UINT32, 1, IARG_THREAD_ID, IARG_END);
+            } else {
+                num_ins++;
+            }
+        }
+        if (num_ins > 0) {
+            BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR)count_and_check,
+                             IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE, thread_data.getReg(),
+                             IARG_UINT32, num_ins, IARG_END);
+            BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR)SwitchPhase,
+                               IARG_CONTEXT, IARG_REG_VALUE, thread_data.getReg(),
+                               IARG_UINT32, num_ins, IARG_THREAD_ID, IARG_END);
+        }
+    }
+}
 
-    outFile <<"RAS: (Correct - Incorrect)\n";
-    for (ras_it = ras_vec.begin(); ras_it != ras_vec.end(); ++ras_it) {
-        RAS *ras = *ras_it;
-        outFile << ras->getNameAndStats() << "\n";
+VOID Trace(TRACE trace, VOID *v)
+{
+    if (sample_schedule) {
+        InstrumentSampledCount(trace);
+        return;
     }
-    outFile << "\n";
 
-    outFile <<"Branch Predictors: (Name - Correct - Incorrect)\n";
-    for (bp_it = branch_predictors.begin(); bp_it != branch_predictors.end(); ++bp_it) {
-        BranchPredictor *curr_predictor = *bp_it;
-        outFile << "  " << curr_predictor->getName() << ": "
-                << curr_predictor->getNumCorrectPredictions() << " "
-                << curr_predictor->getNumIncorrectPredictions() << "\n";
+    // Count the instructions of every basic block with a single call at its
+    // head. REP instructions run their analysis calls once per iteration, so
+    // they keep their own call to count the same way as before.
+    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        UINT32 num_ins = 0;
+        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+            if (INS_HasRealRep(ins))
+                INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)count_instruction,
+                               IARG_REG_VALUE, thread_data.getReg(), IARG_END);
+            else
+                num_ins++;
+        }
+        if (num_ins > 0)
+            BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR)count_bbl_instructions,
+                           IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE, thread_data.getReg(),
+                           IARG_UINT32, num_ins, IARG_END);
     }
-    outFile << "\n";
+}
+
+/* ===================================================================== */
 
-    outFile <<"BTB Predictors: (Name - Correct - Incorrect - TargetCorrect)\n";
-    for (btb_it = btb_predictors.begin(); btb_it != btb_predictors.end(); ++btb_it) {
-        BTBPredictor *curr_predictor = *btb_it;
-        outFile << "  " << curr_predictor->getName() << ": "
-                << curr_predictor->getNumCorrectPredictions() << " "
-                << curr_predictor->getNumIncorrectPredictions() << " "
-                << curr_predictor->getNumCorrectTargetPredictions() << "\n";
+//> Predictors of the knobs, from the specs if there are any
+bool InitPredictorSet(std::vector<BranchPredictor *> &branch_predictors,
+                      std::vector<BTBPredictor *> &btb_predictors,
+                      std::vector<RASGroup *> &ras_vec,
+                      std::vector<IndirectPredictor *> &indirect_predictors, string &error)
+{
+    if (predictor_specs.empty()) {
+        //InitPredictors(branch_predictors);
+        //BTB(btb_predictors);
+        InitRas(ras_vec);
+        InitIndirectPredictors(indirect_predictors);
+    } else if (!BuildPredictorsFromSpecs(predictor_specs, branch_predictors, btb_predictors,
+                                         ras_vec, indirect_predictors, error)) {
+        return false;
     }
+    for (UINT32 i = 0; i < ras_vec.size(); i++)
+        ras_vec[i]->setRepair(ras_repair, wrong_path_rets, wrong_path_calls);
+    return true;
+}
 
-    outFile.close();
+/**
+ * With private predictors the first thread takes the predictors built in
+ * main() and every other thread builds its own, they are added up in Fini().
+ **/
+VOID ThreadStart(THREADID tid, CONTEXT *ctxt, INT32 flags, VOID *v)
+{
+    ThreadData *td = thread_data.add(tid, ctxt);
+    string error;
+
+    td->instructions = 0;
+    if (!private_predictors)
+        return;
+
+    if (thread_data.size() == 1) {
+        td->branch_predictors = branch_predictors;
+        td->btb_predictors = btb_predictors;
+        td->ras_vec = ras_vec;
+        td->indirect_predictors = indirect_predictors;
+    } else {
+        // The thread cannot run on with a partial set, stop the tool
+        if (!InitPredictorSet(td->branch_predictors, td->btb_predictors, td->ras_vec,
+                              td->indirect_predictors, error)) {
+            cerr << "Bad predictor spec: " << error << "\n";
+            PIN_ExitProcess(1);
+        }
+        UINT32 num_restored;
+        if (warm_snapshot
+            && !warm_snapshot->restore(td->branch_predictors, td->btb_predictors, td->ras_vec,
+                                       td->indirect_predictors, false, num_restored, error)) {
+            cerr << "Cannot load the predictor state: " << error << "\n";
+            PIN_ExitProcess(1);
+        }
+    }
+}
+
+//> Adds the counters of the private predictors of every thread into the first
+VOID MergeThreadPredictors()
+{
+    for (UINT32 t = 1; t < thread_data.size(); t++) {
+        ThreadData *td = thread_data[t];
+        for (UINT32 i = 0; i < branch_predictors.size(); i++)
+            branch_predictors[i]->mergeCounters(td->branch_predictors[i]);
+        for (UINT32 i = 0; i < btb_predictors.size(); i++)
+            btb_predictors[i]->mergeCounters(td->btb_predictors[i]);
+        for (UINT32 i = 0; i < ras_vec.size(); i++)
+            ras_vec[i]->mergeCounters(*td->ras_vec[i]);
+        for (UINT32 i = 0; i < indirect_predictors.size(); i++)
+            indirect_predictors[i]->mergeCounters(td->indirect_predictors[i]);
+    }
 }
 
 /* ===================================================================== */
 
-VOID InitPredictors()
+string SymbolOf(ADDRINT ip)
 {
-    // N-bit predictors
-    
-//    // 16K
-//    for (int i=1; i <= 4; i++) {
-//        NbitPredictor *nbitPred = new NbitPredictor(14, i);
-//        branch_predictors.push_back(nbitPred);
-//    }
-//
-//    NbitPredictor *nbitPred = new NbitPredictor(14, 2);
-//    branch_predictors.push_back(nbitPred);
-
-    // Alternative FSMs
-//    TwobitPredictor_FSM1 *nbitPredFSM1 = new TwobitPredictor_FSM1();
-//    branch_predictors.push_back(nbitPredFSM1);
-//    TwobitPredictor_FSM2 *nbitPredFSM2 = new TwobitPredictor_FSM2();
-//    branch_predictors.push_back(nbitPredFSM2);
-//    TwobitPredictor_FSM3 *nbitPredFSM3 = new TwobitPredictor_FSM3();
-//    branch_predictors.push_back(nbitPredFSM3);
-//    TwobitPredictor_FSM4 *nbitPredFSM4 = new TwobitPredictor_FSM4();
-//    branch_predictors.push_back(nbitPredFSM4);
-//    TwobitPredictor_FSM5 *nbitPredFSM5 = new TwobitPredictor_FSM5();
-//    branch_predictors.push_back(nbitPredFSM5);
-//
-//    // 32K hardware
-//    NbitPredictor *onebitPred = new NbitPredictor(15, 1);
-//    branch_predictors.push_back(onebitPred);
-//    NbitPredictor *fourbitPred = new NbitPredictor(13, 4);
-//    branch_predictors.push_back(fourbitPred);    
-//    // Pentium-M predictor
-
-// 5_6
-branch_predictors.push_back(new AlwaysTakenPredictor());
-    
-    // 2) BTFNT
-    branch_predictors.push_back(new BTFNTPredictor());
-    
-    // 3) n-bit predictor
-    NbitPredictor *fourbitPred = new NbitPredictor(13, 4);
-    branch_predictors.push_back(fourbitPred);
-    // 4) Pentium-M 
-    branch_predictors.push_back(new PentiumMBranchPredictor());    
-
-    // 5, 6, 7) Local History Two Level
-    branch_predictors.push_back(new LocalHistoryPredictor(11, 8));
-    branch_predictors.push_back(new LocalHistoryPredictor(12, 4));
-    branch_predictors.push_back(new LocalHistoryPredictor(13, 2));
-
-    // 8, 9) Global History Two Level
-    branch_predictors.push_back(new GlobalHistoryPredictor(14, 2));
-    branch_predictors.push_back(new GlobalHistoryPredictor(13, 4));
-    
-    // 10) Alpha21264
-    branch_predictors.push_back(new Alpha21264());
-    
-    // 11, ..., 16) Tournament Hybrid Predictors
-    branch_predictors.push_back(new TournamentHybridPredictor(10, 
-	new NbitPredictor(13, 2), // 8K entries, 2bit predictor
-	new NbitPredictor(12, 4)  // 4K entries, 4bit predictor
-    ));
-    branch_predictors.push_back(new TournamentHybridPredictor(11,
-	new NbitPredictor(13, 2), // 8K entries, 2bit predictor
-	new GlobalHistoryPredictor(13, 2) // 8K entries, 2bit global history predictor
-    ));
-    branch_predictors.push_back(new TournamentHybridPredictor(11,
-	new NbitPredictor(13, 2), // 8K entries, 2bit predictor
-	new LocalHistoryPredictor(12, 2, 12, 2) // local history predictor, BHT and PHT:4K entries 2bit each
-    ));
-    branch_predictors.push_back(new TournamentHybridPredictor(11,
-	new LocalHistoryPredictor(12, 2, 12, 2),
-	new GlobalHistoryPredictor(13, 2)
-    ));
-    branch_predictors.push_back(new TournamentHybridPredictor(11,
-	new GlobalHistoryPredictor(13, 2),
-	new GlobalHistoryPredictor(12, 4) // 4K entries, 4bit global history predictor
-    ));
-    branch_predictors.push_back(new TournamentHybridPredictor(11,
-	new LocalHistoryPredictor(12, 2, 12, 2),
-	new LocalHistoryPredictor(11, 4, 12, 2) // local history predictor,BHT:2K entries,4bit,PHT:4K entries,2bit
-    ));
+    string name;
 
+    PIN_LockClient();
+    name = RTN_FindNameByAddress(ip);
+    PIN_UnlockClient();
+    return name;
 }
 
-VOID BTB()
+VOID PrepareForFini(VOID * v)
 {
-    btb_predictors.push_back(new BTBPredictor(512, 1));
-    btb_predictors.push_back(new BTBPredictor(512, 2));
-    btb_predictors.push_back(new BTBPredictor(256, 2));
-    btb_predictors.push_back(new BTBPredictor(256, 4));
-    btb_predictors.push_back(new BTBPredictor(128, 2));
-    btb_predictors.push_back(new BTBPredictor(128, 4));
-    btb_predictors.push_back(new BTBPredictor(64, 4));
-    btb_predictors.push_back(new BTBPredictor(64, 8));
+    std::vector<PredictorWorker *>::iterator w_it;
+
+    if (workers.empty())
+        return;
+
+    // Stop the workers, whatever is still buffered is evaluated by
+    // BufferFull() directly
+    PIN_GetLock(&predictors_lock, 1);
+    workers_exit = TRUE;
+    for (w_it = workers.begin(); w_it != workers.end(); ++w_it)
+        PIN_SemaphoreSet(&(*w_it)->batch_ready);
+    PIN_ReleaseLock(&predictors_lock);
 }
 
-VOID InitRas()
+VOID Fini(int code, VOID * v)
 {
-    for (UINT32 i = 4; i <= 64; i*=2) {
-        ras_vec.push_back(new RAS(i));
-        if (i == 32)
-            ras_vec.push_back(new RAS(48));
+    std::vector<PredictorWorker *>::iterator w_it;
+
+    // Every predictor is owned by exactly one worker, so once they are gone
+    // the counters in all the predictor vectors are final
+    for (w_it = workers.begin(); w_it != workers.end(); ++w_it)
+        PIN_WaitForThreadTermination((*w_it)->uid, PIN_INFINITE_TIMEOUT, NULL);
+
+    if (private_predictors)
+        MergeThreadPredictors();
+
+    UINT64 total_instructions = TotalInstructions();
+    PrintStats(outFile, total_instructions, branch_predictors, btb_predictors, ras_vec,
+               indirect_predictors);
+    if (timing_model) {
+        outFile << "\n";
+        timing_model->print(outFile, total_instructions, branch_predictors, btb_predictors,
+                            ras_vec, indirect_predictors);
+    }
+    if (KnobStorage.Value()) {
+        outFile << "\n";
+        PrintStorage(outFile, total_instructions, branch_predictors, btb_predictors, ras_vec,
+                     indirect_predictors);
+    }
 
-        }
+    //> Only printed for multithreaded runs, so that the output of single
+    //  threaded ones stays the same
+    if (thread_data.size() > 1) {
+        outFile << "\n";
+        outFile << "Threads: (Thread - Instructions)\n";
+        for (UINT32 i = 0; i < thread_data.size(); i++)
+            outFile << "  " << i << ": " << thread_data[i]->instructions << "\n";
     }
 
+    // A detail window cut short by the end of the run counts for what it ran,
+    // up to the count of the thread that went furthest, as in SwitchPhase()
+    if (sample_schedule) {
+        UINT64 last_instruction = 0;
+        for (UINT32 i = 0; i < thread_data.size(); i++)
+            last_instruction = std::max(last_instruction, thread_data[i]->instructions);
+        if (sample_schedule->getPhase() == SAMPLE_DETAIL)
+            window_instructions.push_back(last_instruction - detail_start);
+        CatchUpEpoch(sample_schedule->getEpoch() + (sample_schedule->getPhase() == SAMPLE_DETAIL));
+        outFile << "\n";
+        sample_stats->print(outFile, sample_schedule->isPeriodic());
+    }
+    outFile.close();
+
+    if (interval_stats) {
+        interval_stats->finish(total_instructions);
+        intervalFile.close();
+    }
+
+    // The tables of the first thread, with the counters of all of them
+    if (!KnobSaveState.Value().empty())
+        SaveState(total_instructions);
+
+    if (branch_sketch) {
+        std::ofstream profileFile(KnobProfileFile.Value().c_str());
+        PrintProfiles(profileFile, branch_predictors, *branch_sketch, SymbolOf);
+    }
+}
+
+/* ===================================================================== */
+
 int main(int argc, char *argv[])
 {
     PIN_InitSymbols();
@@ -274,23 +598,122 @@ int main(int argc, char *argv[])
     if(PIN_Init(argc,argv))
         return Usage();
 
+    if (!ParseRASRepair(KnobRasRepair.Value(), ras_repair, wrong_path_rets, wrong_path_calls))
+        return Usage();
+
+    if (!KnobTiming.Value().empty()) {
+        timing_model = new TimingModel();
+        if (!timing_model->parse(KnobTiming.Value()))
+            return Usage();
+    }
+
     // Open output file
     outFile.open(KnobOutputFile.Value().c_str());
 
-    // Initialize predictors and RAS vector
-    //InitPredictors();
-    //BTB();
-    InitRas();
+    // Initialize predictors and RAS vector, from the specs if there are any
+    string error;
+    for (UINT32 i = 0; i < KnobSpec.NumberOfValues(); i++)
+        if (!KnobSpec.Value(i).empty())
+            predictor_specs += KnobSpec.Value(i) + "\n";
+    for (UINT32 i = 0; i < KnobSpecFile.NumberOfValues(); i++) {
+        if (!KnobSpecFile.Value(i).empty()
+            && !ReadPredictorSpecFile(KnobSpecFile.Value(i), predictor_specs)) {
+            cerr << "Cannot read spec file " << KnobSpecFile.Value(i) << "\n";
+            return -1;
+        }
+    }
+
+    if (!InitPredictorSet(branch_predictors, btb_predictors, ras_vec, indirect_predictors, error)) {
+        cerr << "Bad predictor spec: " << error << "\n";
+        return -1;
+    }
+
+    if (KnobThreadMode.Value() == "private") {
+        private_predictors = TRUE;
+        // These follow the predictors of all the threads at once
+        if (KnobThreads.Value() > 0 || KnobProfile.Value() > 0 || KnobDetail.Value() > 0
+            || KnobInterval.Value() > 0 || KnobCheckpoint.Value() > 0) {
+            cerr << "-thread_mode private does not support -threads, -profile, -detail, -interval or -checkpoint\n";
+            return -1;
+        }
+    } else if (KnobThreadMode.Value() != "shared") {
+        return Usage();
+    }
+
+    // Only the tables are warmed up, the counters of the run start from 0
+    if (!KnobLoadState.Value().empty()) {
+        UINT32 num_restored;
+        warm_snapshot = new PredictorSnapshot();
+        if (!warm_snapshot->read(KnobLoadState.Value(), error)
+            || !warm_snapshot->restore(branch_predictors, btb_predictors, ras_vec,
+                                       indirect_predictors, false, num_restored, error)) {
+            cerr << "Cannot load the predictor state: " << error << "\n";
+            return -1;
+        }
+        cerr << "Loaded the state of " << num_restored << " predictors from "
+             << KnobLoadState.Value() << "\n";
+    }
+    if (KnobCheckpoint.Value() > 0) {
+        if (KnobSaveState.Value().empty()) {
+            cerr << "-checkpoint needs -save_state\n";
+            return -1;
+        }
+        next_checkpoint = KnobCheckpoint.Value();
+    }
+
+    if (KnobProfile.Value() > 0) {
+        InitProfiles(branch_predictors, KnobProfile.Value());
+        branch_sketch = new BranchCountSketch();
+    }
+
+    if (KnobDetail.Value() > 0) {
+        if (KnobSimPoints.Value().empty()) {
+            sample_schedule = new SampleSchedule(KnobFastForward.Value(), KnobWarmup.Value(),
+                                                 KnobDetail.Value());
+        } else {
+            sample_schedule = new SampleSchedule(KnobWarmup.Value(), KnobDetail.Value());
+            if (!sample_schedule->readPoints(KnobSimPoints.Value(), error)) {
+                cerr << "Bad simulation points: " << error << "\n";
+                return -1;
+            }
+        }
+        sample_stats = new SampleStats();
+        sample_stats->start(branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+    }
+
+    if (KnobInterval.Value() > 0) {
+        intervalFile.open(KnobIntervalFile.Value().c_str());
+        interval_stats = new IntervalStats(intervalFile, KnobInterval.Value());
+        interval_stats->start(branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+    }
+
+    branch_buffer = DefineBranchBuffer(KnobBatchSize.Value(), BufferFull);
+    if (branch_buffer == BUFFER_ID_INVALID) {
+        cerr << "Cannot allocate the branch buffer\n";
+        return -1;
+    }
+    PIN_InitLock(&predictors_lock);
+    if (!thread_data.init()) {
+        cerr << "Cannot allocate the thread data\n";
+        return -1;
+    }
+
+    if (KnobThreads.Value() > 0)
+        InitWorkers(KnobThreads.Value());
 
     // Instrument function calls in order to catch __parsec_roi_{begin,end}
     INS_AddInstrumentFunction(Instruction, 0);
+    TRACE_AddInstrumentFunction(Trace, 0);
+
+    PIN_AddThreadStartFunction(ThreadStart, 0);
 
     // Called when the instrumented application finishes its execution
+    PIN_AddPrepareForFiniFunction(PrepareForFini, 0);
     PIN_AddFiniFunction(Fini, 0);
 
     // Never returns
     PIN_StartProgram();
-    
+
     return 0;
 }
 
@@ -3,9 +3,12 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstring>
 
 using namespace std;
 
+#include "thread_data.h"
+
 /* ===================================================================== */
 /* Commandline Switches                                                  */
 /* ===================================================================== */
@@ -22,9 +25,15 @@ struct branch_stats_s {
            unconditional,
            call,
            ret;
-} branch_stats;
+};
+
+//> Every thread counts on its own, the counts are added up in Fini()
+struct thread_stats_s {
+    branch_stats_s branch_stats;
+    UINT64 total_instructions;
+};
+ThreadDataRegistry<thread_stats_s> thread_stats;
 
-UINT64 total_instructions;
 std::ofstream outFile;
 
 /* ===================================================================== */
@@ -39,56 +48,104 @@ INT32 Usage()
 
 /* ===================================================================== */
 
-VOID count_instruction()
+VOID count_instruction(thread_stats_s *stats)
 {
-    total_instructions++;
+    stats->total_instructions++;
 }
 
-VOID call_instruction()
+VOID PIN_FAST_ANALYSIS_CALL count_bbl_instructions(thread_stats_s *stats, UINT32 num_ins)
 {
-    branch_stats.call++;
-    branch_stats.total++;
+    stats->total_instructions += num_ins;
 }
 
-VOID ret_instruction()
+VOID call_instruction(thread_stats_s *stats)
 {
-    branch_stats.ret++;
-    branch_stats.total++;
+    stats->branch_stats.call++;
+    stats->branch_stats.total++;
 }
 
-VOID conditional_instruction(BOOL taken)
+VOID ret_instruction(thread_stats_s *stats)
 {
-    branch_stats.conditional[taken]++;
-    branch_stats.total++;
+    stats->branch_stats.ret++;
+    stats->branch_stats.total++;
 }
 
-VOID unconditional_instruction()
+VOID conditional_instruction(thread_stats_s *stats, BOOL taken)
 {
-    branch_stats.unconditional++;
-    branch_stats.total++;
+    stats->branch_stats.conditional[taken]++;
+    stats->branch_stats.total++;
+}
+
+VOID unconditional_instruction(thread_stats_s *stats)
+{
+    stats->branch_stats.unconditional++;
+    stats->branch_stats.total++;
 }
 
 VOID Instruction(INS ins, void * v)
 {
+    REG stats_reg = thread_stats.getReg();
+
     if (INS_Category(ins) == XED_CATEGORY_COND_BR)
         INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)conditional_instruction,
-                       IARG_BRANCH_TAKEN, IARG_END);
+                       IARG_REG_VALUE, stats_reg, IARG_BRANCH_TAKEN, IARG_END);
     else if (INS_Category(ins) == XED_CATEGORY_UNCOND_BR)
         INS_InsertCall(ins, IPOINT_BEFORE,
-                       (AFUNPTR)unconditional_instruction, IARG_END);
+                       (AFUNPTR)unconditional_instruction, IARG_REG_VALUE, stats_reg, IARG_END);
     else if (INS_IsCall(ins))
-        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)call_instruction, IARG_END);
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)call_instruction,
+                       IARG_REG_VALUE, stats_reg, IARG_END);
     else if (INS_IsRet(ins))
-        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)ret_instruction, IARG_END);
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)ret_instruction,
+                       IARG_REG_VALUE, stats_reg, IARG_END);
+}
 
-    // Count each and every instruction
-    INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)count_instruction, IARG_END);
+VOID Trace(TRACE trace, VOID *v)
+{
+    // Count the instructions of every basic block with a single call at its
+    // head. REP instructions run their analysis calls once per iteration, so
+    // they keep their own call to count the same way as before.
+    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        UINT32 num_ins = 0;
+        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+            if (INS_HasRealRep(ins))
+                INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)count_instruction,
+                               IARG_REG_VALUE, thread_stats.getReg(), IARG_END);
+            else
+                num_ins++;
+        }
+        if (num_ins > 0)
+            BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR)count_bbl_instructions,
+                           IARG_FAST_ANALYSIS_CALL, IARG_REG_VALUE, thread_stats.getReg(),
+                           IARG_UINT32, num_ins, IARG_END);
+    }
 }
 
 /* ===================================================================== */
 
+VOID ThreadStart(THREADID tid, CONTEXT *ctxt, INT32 flags, VOID *v)
+{
+    thread_stats_s *stats = thread_stats.add(tid, ctxt);
+    memset(stats, 0, sizeof(*stats));
+}
+
 VOID Fini(int code, VOID * v)
 {
+    branch_stats_s branch_stats;
+    UINT64 total_instructions = 0;
+
+    memset(&branch_stats, 0, sizeof(branch_stats));
+    for (UINT32 i = 0; i < thread_stats.size(); i++) {
+        const thread_stats_s *stats = thread_stats[i];
+        branch_stats.total += stats->branch_stats.total;
+        branch_stats.conditional[0] += stats->branch_stats.conditional[0];
+        branch_stats.conditional[1] += stats->branch_stats.conditional[1];
+        branch_stats.unconditional += stats->branch_stats.unconditional;
+        branch_stats.call += stats->branch_stats.call;
+        branch_stats.ret += stats->branch_stats.ret;
+        total_instructions += stats->total_instructions;
+    }
+
     // Report total instructions and total cycles
     outFile << "Total Instructions: " << total_instructions << "\n";
     outFile << "\n";
@@ -116,8 +173,15 @@ int main(int argc, char *argv[])
     // Open output file
     outFile.open(KnobOutputFile.Value().c_str());
 
+    if (!thread_stats.init()) {
+        cerr << "Cannot allocate the thread data\n";
+        return -1;
+    }
+    PIN_AddThreadStartFunction(ThreadStart, 0);
+
     // Instrument function calls in order to catch __parsec_roi_{begin,end}
     INS_AddInstrumentFunction(Instruction, 0);
+    TRACE_AddInstrumentFunction(Trace, 0);
 
     // Called when the instrumented application finishes its execution
     PIN_AddFiniFunction(Fini, 0);
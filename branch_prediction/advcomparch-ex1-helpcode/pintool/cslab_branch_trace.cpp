@@ -0,0 +1,146 @@
+#include "pin.H"
+
+#include <iostream>
+#include <fstream>
+#include <cassert>
+
+using namespace std;
+
+#include "branch_trace.h"
+
+/* ===================================================================== */
+/* Commandline Switches                                                  */
+/* ===================================================================== */
+KNOB<string> KnobOutputFile(KNOB_MODE_WRITEONCE,    "pintool",
+    "o", "cslab_branch.trace", "specify branch trace file name");
+/* ===================================================================== */
+
+/* ===================================================================== */
+/* Global Variables                                                      */
+/* ===================================================================== */
+BranchTraceWriter traceWriter;
+
+UINT64 total_instructions;
+
+/* ===================================================================== */
+
+INT32 Usage()
+{
+    cerr << "This tool records the branches of the application to a trace file\n"
+            "that can be replayed through the predictors with bp_replay.\n\n";
+    cerr << KNOB_BASE::StringKnobSummary();
+    cerr << endl;
+    return -1;
+}
+
+/* ===================================================================== */
+
+VOID count_instruction()
+{
+    total_instructions++;
+}
+
+VOID PIN_FAST_ANALYSIS_CALL count_bbl_instructions(UINT32 num_ins)
+{
+    total_instructions += num_ins;
+}
+
+//> The instructions of a basic block are counted at its head, so the branch
+//  subtracts the ones from itself to the end of the block that are already
+//  included in total_instructions.
+VOID record_branch(ADDRINT ip, ADDRINT target, BOOL taken, UINT32 kind, UINT32 ins_size,
+                   UINT32 counted_ahead)
+{
+    BranchRecord rec;
+
+    rec.ip = ip;
+    rec.target = target;
+    rec.icount = total_instructions - counted_ahead;
+    rec.kind = kind;
+    rec.size = ins_size;
+    rec.taken = taken;
+    traceWriter.write(rec);
+}
+
+UINT32 BranchKindOf(INS ins)
+{
+    // Same classification as cslab_branch, so that a replay feeds every
+    // predictor exactly the branches it would see under Pin
+    if (INS_Category(ins) == XED_CATEGORY_COND_BR)
+        return BRANCH_COND;
+    else if (INS_IsCall(ins))
+        return INS_IsIndirectControlFlow(ins) ? BRANCH_IND_CALL : BRANCH_CALL;
+    else if (INS_IsRet(ins))
+        return BRANCH_RET;
+    else if (INS_IsBranch(ins))
+        return INS_IsIndirectControlFlow(ins) ? BRANCH_IND_JUMP : BRANCH_JUMP;
+    return BRANCH_NUM_KINDS;
+}
+
+VOID Trace(TRACE trace, VOID *v)
+{
+    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        UINT32 num_ins = 0, counted = 0;
+
+        // One call per basic block counts its instructions. REP instructions
+        // run their analysis calls once per iteration and keep their own.
+        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins))
+            if (!INS_HasRealRep(ins))
+                num_ins++;
+        if (num_ins > 0)
+            BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR)count_bbl_instructions,
+                           IARG_FAST_ANALYSIS_CALL, IARG_UINT32, num_ins, IARG_END);
+
+        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+            UINT32 kind = BranchKindOf(ins);
+
+            if (kind != BRANCH_NUM_KINDS)
+                INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)record_branch,
+                               IARG_INST_PTR, IARG_BRANCH_TARGET_ADDR, IARG_BRANCH_TAKEN,
+                               IARG_UINT32, kind, IARG_UINT32, INS_Size(ins),
+                               IARG_UINT32, num_ins - counted, IARG_END);
+
+            if (INS_HasRealRep(ins))
+                INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)count_instruction, IARG_END);
+            else
+                counted++;
+        }
+    }
+}
+
+/* ===================================================================== */
+
+VOID Fini(int code, VOID * v)
+{
+    traceWriter.close(total_instructions);
+}
+
+/* ===================================================================== */
+
+int main(int argc, char *argv[])
+{
+    PIN_InitSymbols();
+
+    if(PIN_Init(argc,argv))
+        return Usage();
+
+    // Open trace file
+    if (!traceWriter.open(KnobOutputFile.Value().c_str())) {
+        cerr << "Cannot open trace file " << KnobOutputFile.Value() << "\n";
+        return -1;
+    }
+
+    TRACE_AddInstrumentFunction(Trace, 0);
+
+    // Called when the instrumented application finishes its execution
+    PIN_AddFiniFunction(Fini, 0);
+
+    // Never returns
+    PIN_StartProgram();
+
+    return 0;
+}
+
+/* ===================================================================== */
+/* eof */
+/* ===================================================================== */
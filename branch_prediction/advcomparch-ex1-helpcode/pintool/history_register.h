@@ -0,0 +1,130 @@
+#ifndef HISTORY_REGISTER_H
+#define HISTORY_REGISTER_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "state_archive.h"
+
+/**
+ * A branch history of any length.
+ *
+ * value(n) gives the newest n <= 64 outcomes in the same layout as
+ * ShiftRegister: the newest one in bit n-1 and older ones below it.
+ * Histories longer than 64 bits are kept in a circular bit buffer, so that
+ * bit(age) and push() are O(1) whatever the length.
+ *
+ * A folded view compresses the newest orig_length outcomes into width bits
+ * by XORing width-bit chunks together. Views are updated incrementally on
+ * every push() (the new outcome enters, the one that falls out of the view
+ * leaves), so reading one is a load and pushing costs O(number of views).
+ **/
+class HistoryRegister
+{
+public:
+    HistoryRegister(unsigned length_ = 64) : length(length_), recent(0), head(0) {
+        assert(length >= 1);
+        if (length > 64) {
+            unsigned capacity = 128;
+            while (capacity < length)
+                capacity *= 2;
+            buffer.resize(capacity / 64, 0);
+        }
+    };
+
+    unsigned getLength() const { return length; }
+
+    //> Newest n outcomes, newest in bit n-1
+    UINT64 value(unsigned n) const {
+        return n == 0 ? 0 : recent >> (64 - n);
+    }
+
+    //> Outcome of age branches ago, age 0 is the newest
+    bool bit(unsigned age) const {
+        if (age < 64)
+            return (recent >> (63 - age)) & 1;
+        if (age >= length)
+            return false;
+        unsigned pos = (head - age) & (buffer.size() * 64 - 1);
+        return (buffer[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    //> Adds a folded view of the newest orig_length outcomes into width bits,
+    //  returns the id to pass to folded()
+    unsigned addFold(unsigned orig_length, unsigned width) {
+        FoldedHistory f;
+
+        assert(orig_length <= length && width >= 1 && width <= 32);
+        f.orig_length = orig_length;
+        f.width = width;
+        f.outpoint = orig_length % width;
+        f.mask = (width == 32) ? 0xffffffffu : (1u << width) - 1;
+        f.comp = 0;
+        // Build the view from the outcomes already in the register
+        for (unsigned age = orig_length; age-- > 0; )
+            f.comp = f.shift(bit(age), false);
+        folds.push_back(f);
+        return folds.size() - 1;
+    }
+
+    UINT32 folded(unsigned id) const { return folds[id].comp; }
+
+    void push(bool taken) {
+        for (std::vector<FoldedHistory>::iterator it = folds.begin(); it != folds.end(); ++it)
+            it->comp = it->shift(taken, bit(it->orig_length - 1));
+
+        if (!buffer.empty()) {
+            head = (head + 1) & (buffer.size() * 64 - 1);
+            UINT64 mask = 1ULL << (head % 64);
+            buffer[head / 64] = taken ? (buffer[head / 64] | mask) : (buffer[head / 64] & ~mask);
+        }
+        recent = (recent >> 1) | ((UINT64)taken << 63);
+        if (length < 64)
+            recent &= ~0ULL << (64 - length);
+    }
+
+    void clear() {
+        recent = 0;
+        head = 0;
+        std::fill(buffer.begin(), buffer.end(), 0);
+        for (std::vector<FoldedHistory>::iterator it = folds.begin(); it != folds.end(); ++it)
+            it->comp = 0;
+    }
+
+    //> The outcomes and the folded views, not the fold parameters
+    void serialize(StateArchive &ar) {
+        std::vector<UINT32> comps(folds.size());
+
+        for (UINT32 i = 0; i < folds.size(); i++)
+            comps[i] = folds[i].comp;
+        ar.io(recent);
+        ar.io(head);
+        ar.io(buffer);
+        ar.io(comps);
+        if (ar.isLoading() && ar.good())
+            for (UINT32 i = 0; i < folds.size(); i++)
+                folds[i].comp = comps[i];
+    }
+
+private:
+    struct FoldedHistory {
+        unsigned orig_length, width, outpoint;
+        UINT32 mask, comp;
+
+        UINT32 shift(bool in, bool out) const {
+            UINT64 c = ((UINT64)comp << 1) | in;
+            c ^= (UINT64)out << outpoint;
+            c ^= c >> width;
+            return (UINT32)c & mask;
+        }
+    };
+
+    unsigned length;
+    UINT64 recent;              // newest 64 outcomes, newest in bit 63
+    unsigned head;              // position of the newest outcome in buffer
+    std::vector<UINT64> buffer; // only for histories longer than 64
+    std::vector<FoldedHistory> folds;
+};
+
+#endif
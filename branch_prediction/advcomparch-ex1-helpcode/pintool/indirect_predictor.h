@@ -0,0 +1,376 @@
+#ifndef INDIRECT_PREDICTOR_H
+#define INDIRECT_PREDICTOR_H
+
+#include <sstream>
+#include <vector>
+#include <cmath>
+
+#include "branch_trace.h"
+#include "counter_table.h"
+#include "history_register.h"
+#include "state_archive.h"
+
+/**
+ * A generic IndirectPredictor base class.
+ * Indirect target predictors guess the target of indirect jumps and calls;
+ * a prediction is correct only when the whole target matches. Conditional
+ * branches are shown to them too, so that they can keep a history.
+ **/
+class IndirectPredictor
+{
+public:
+    IndirectPredictor() : correct_predictions(0), incorrect_predictions(0) {};
+    virtual ~IndirectPredictor() {};
+
+    //> Predicted target of the indirect branch at ip, 0 when there is none
+    virtual ADDRINT predict(ADDRINT ip) = 0;
+    virtual void update(ADDRINT predicted, ADDRINT ip, ADDRINT target) = 0;
+    virtual string getName() = 0;
+    virtual UINT64 getStorageBits() = 0;
+
+    //> Conditional branches only feed the histories
+    virtual void condBranch(ADDRINT ip, bool taken) {}
+
+    virtual void accessBatch(const BranchRecord *batch, UINT32 num_records) {
+        for (UINT32 i = 0; i < num_records; i++) {
+            const BranchRecord &rec = batch[i];
+            if (IsIndirectKind(rec.kind))
+                update(predict(rec.ip), rec.ip, rec.target);
+            else if (rec.kind == BRANCH_COND)
+                condBranch(rec.ip, rec.taken);
+        }
+    }
+
+    UINT64 getNumCorrectPredictions() { return correct_predictions; }
+    UINT64 getNumIncorrectPredictions() { return incorrect_predictions; }
+
+    //> Adds the counters of another instance of the same predictor
+    void mergeCounters(IndirectPredictor *other) {
+        correct_predictions += other->correct_predictions;
+        incorrect_predictions += other->incorrect_predictions;
+    }
+
+    //> Tables and histories, see predictor_snapshot.h
+    virtual void serializeState(StateArchive &ar) = 0;
+
+    //> The prediction counters, only restored when a run is resumed
+    void serializeCounters(StateArchive &ar) {
+        ar.io(correct_predictions);
+        ar.io(incorrect_predictions);
+    }
+
+protected:
+    void updateCounters(ADDRINT predicted, ADDRINT actual) {
+        if (predicted == actual)
+            correct_predictions++;
+        else
+            incorrect_predictions++;
+    };
+
+private:
+    UINT64 correct_predictions;
+    UINT64 incorrect_predictions;
+};
+
+/**
+ * Indirect BTB: a direct mapped, untagged table of last seen targets.
+ * With history_bits > 0 the index also takes that many bits of a path
+ * history of the recent indirect targets, folded to index_bits, so a
+ * branch can keep one target per path (a target cache).
+ **/
+class IBTBPredictor : public IndirectPredictor {
+public:
+	IBTBPredictor(unsigned index_bits, unsigned history_bits = 0)
+		: index_bits(index_bits), history_bits(history_bits), path(0),
+		  targets(1u << index_bits, 0) {
+		assert(history_bits <= 64);
+	}
+	~IBTBPredictor() { }
+
+	virtual ADDRINT predict(ADDRINT ip) {
+		return this->targets[this->index(ip)];
+	}
+
+	virtual void update(ADDRINT predicted, ADDRINT ip, ADDRINT target) {
+		updateCounters(predicted, target);
+		this->targets[this->index(ip)] = target;
+		this->path = (this->path << 3) ^ (target >> 2);
+	}
+
+	virtual string getName() {
+		std::ostringstream stream;
+		stream << "iBTB-" << this->targets.size();
+		if (this->history_bits > 0)
+			stream << "-path" << this->history_bits;
+		return stream.str();
+	}
+
+	virtual UINT64 getStorageBits() {
+		return (UINT64)this->targets.size() * 8 * sizeof(ADDRINT) + this->history_bits;
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		ar.io(this->path);
+		ar.io(this->targets);
+	}
+
+private:
+	unsigned index_bits, history_bits;
+	UINT64 path;
+	std::vector<ADDRINT> targets;
+
+	unsigned index(ADDRINT ip) {
+		// the path register is 64 bits, so 64 takes it whole
+		UINT64 history = this->history_bits >= 64 ? this->path
+		               : this->path & ((1ULL << this->history_bits) - 1);
+		UINT64 folded = 0;
+
+		// XOR index_bits chunks, so no history bit falls outside the index
+		for (; history; history >>= this->index_bits)
+			folded ^= history;
+		return (ip ^ (ip >> this->index_bits) ^ folded) & (this->targets.size() - 1);
+	}
+};
+
+// Same aging of the useful bits as TAGE
+#define ITTAGE_AGING_PERIOD (1 << 18)
+
+/**
+ * ITTAGE-style indirect target predictor: a PC-indexed target table backed
+ * by tagged tables indexed with geometrically longer global histories, the
+ * target TAGE of Seznec's ITTAGE. Every entry has a target, a 2-bit
+ * confidence counter and a 2-bit useful counter. The history takes the
+ * outcome of every conditional branch and two bits of every indirect target.
+ **/
+class ITTAGEPredictor : public IndirectPredictor {
+public:
+	ITTAGEPredictor(unsigned num_tables, unsigned log_entries, unsigned tag_bits,
+	                unsigned min_history, unsigned max_history, unsigned log_base)
+		: num_tables(num_tables), log_entries(log_entries), tag_bits(tag_bits),
+		  base(1u << log_base, 0), tables(num_tables << log_entries),
+		  phist(0), use_alt_on_na(0), num_branches(0), seed(0x2545F491),
+		  indices(num_tables), tags(num_tables) {
+		assert(num_tables >= 1 && tag_bits >= 2 && tag_bits <= 16 && min_history >= 1);
+		for (std::size_t i = 0; i < this->tables.size(); i++) {
+			this->tables[i].target = 0;
+			this->tables[i].tag = 0;
+			this->tables[i].ctr = this->tables[i].u = this->tables[i].valid = 0;
+		}
+
+		// geometric series of history lengths
+		for (unsigned i = 0; i < num_tables; i++) {
+			double ratio = num_tables > 1 ? (double)i / (num_tables - 1) : 0;
+			unsigned len = (unsigned)(min_history * pow((double)max_history / min_history, ratio) + 0.5);
+			if (i > 0 && len <= this->history_lengths[i - 1])
+				len = this->history_lengths[i - 1] + 1;
+			this->history_lengths.push_back(len);
+		}
+
+		this->ghist = HistoryRegister(this->history_lengths[num_tables - 1]);
+		for (unsigned i = 0; i < num_tables; i++) {
+			this->index_fold.push_back(this->ghist.addFold(this->history_lengths[i], log_entries));
+			this->tag_fold0.push_back(this->ghist.addFold(this->history_lengths[i], tag_bits));
+			this->tag_fold1.push_back(this->ghist.addFold(this->history_lengths[i], tag_bits - 1));
+		}
+	}
+	~ITTAGEPredictor() { }
+
+	virtual ADDRINT predict(ADDRINT ip) {
+		this->lookup(ip);
+		return this->pred;
+	}
+
+	virtual void update(ADDRINT predicted, ADDRINT ip, ADDRINT target) {
+		updateCounters(predicted, target);
+		this->train(ip, target);
+		// two bits of a hash of the target, so that targets that differ in
+		// any of the low bits leave a different history
+		ADDRINT hash = (target >> 2) ^ (target >> 5) ^ (target >> 8);
+		this->ghist.push(hash & 1);
+		this->ghist.push((hash >> 1) & 1);
+		this->phist = ((this->phist << 1) | ((ip >> 2) & 1)) & 0xffff;
+	}
+
+	virtual void condBranch(ADDRINT ip, bool taken) {
+		this->ghist.push(taken);
+		this->phist = ((this->phist << 1) | (ip & 1)) & 0xffff;
+	}
+
+	virtual string getName() {
+		std::ostringstream stream;
+		stream << "ITTAGE-" << this->getTableBits() / 1024.0 << "Kbit (tables="
+		       << this->num_tables << ", entries=" << (1 << this->log_entries)
+		       << ", history=" << this->history_lengths[0] << "-"
+		       << this->history_lengths[this->num_tables - 1] << ")";
+		return stream.str();
+	}
+
+	//> As TAGEPredictor, the tables plus the histories and counters
+	virtual UINT64 getStorageBits() {
+		return this->getTableBits() + this->ghist.getLength() + 16 + 4
+		       + CeilLog2(ITTAGE_AGING_PERIOD);
+	}
+
+	UINT64 getTableBits() {
+		return (UINT64)this->base.size() * 8 * sizeof(ADDRINT)
+		       + (UINT64)this->tables.size() * (8 * sizeof(ADDRINT) + 2 + 2 + 1 + this->tag_bits);
+	}
+
+	virtual void serializeState(StateArchive &ar) {
+		ar.io(this->base);
+		ar.io(this->tables);
+		this->ghist.serialize(ar);
+		ar.io(this->phist);
+		ar.io(this->use_alt_on_na);
+		ar.io(this->num_branches);
+		ar.io(this->seed);
+	}
+
+private:
+	struct ITTageEntry {
+		ADDRINT target;
+		UINT16 tag;
+		UINT8 ctr;  // 2-bit confidence in the target
+		UINT8 u;    // 2-bit useful counter
+		UINT8 valid; // never allocated entries match no tag
+	};
+
+	unsigned num_tables, log_entries, tag_bits;
+	std::vector<unsigned> history_lengths;
+	std::vector<ADDRINT> base;
+	std::vector<ITTageEntry> tables; // num_tables << log_entries entries
+	HistoryRegister ghist;
+	UINT32 phist; // path history, one address bit per branch
+	std::vector<unsigned> index_fold, tag_fold0, tag_fold1; // ghist fold ids
+	INT32 use_alt_on_na;
+	UINT64 num_branches;
+	UINT32 seed;
+
+	// state of the last lookup()
+	std::vector<unsigned> indices;
+	std::vector<UINT16> tags;
+	int provider, alt_provider;
+	ADDRINT pred, alt_pred;
+	bool provider_weak;
+
+	ITTageEntry &entry(unsigned table) {
+		return this->tables[(table << this->log_entries) + this->indices[table]];
+	}
+
+	unsigned baseIndex(ADDRINT ip) {
+		return (ip ^ (ip >> 2)) & (this->base.size() - 1);
+	}
+
+	void lookup(ADDRINT ip) {
+		unsigned index_mask = (1u << this->log_entries) - 1;
+
+		this->provider = this->alt_provider = -1;
+		for (int i = this->num_tables - 1; i >= 0; i--) {
+			unsigned len = this->history_lengths[i];
+			UINT32 path = this->phist & ((1u << (len < 16 ? len : 16)) - 1);
+
+			this->indices[i] = (ip ^ (ip >> (this->log_entries - i % this->log_entries))
+			                    ^ this->ghist.folded(this->index_fold[i])
+			                    ^ path ^ (path >> this->log_entries)) & index_mask;
+			this->tags[i] = (ip ^ this->ghist.folded(this->tag_fold0[i])
+			                 ^ (this->ghist.folded(this->tag_fold1[i]) << 1))
+			                & ((1u << this->tag_bits) - 1);
+
+			if (this->entry(i).valid && this->entry(i).tag == this->tags[i]) {
+				if (this->provider < 0)
+					this->provider = i;
+				else if (this->alt_provider < 0)
+					this->alt_provider = i;
+			}
+		}
+
+		this->alt_pred = this->alt_provider >= 0 ? this->entry(this->alt_provider).target
+		                                         : this->base[this->baseIndex(ip)];
+		if (this->provider < 0) {
+			this->pred = this->alt_pred;
+			this->provider_weak = false;
+			return;
+		}
+
+		ITTageEntry &e = this->entry(this->provider);
+		// a newly allocated entry is often worse than the alternate prediction
+		this->provider_weak = e.ctr == 0 && e.u == 0;
+		if (this->provider_weak && this->use_alt_on_na >= 0)
+			this->pred = this->alt_pred;
+		else
+			this->pred = e.target;
+	}
+
+	void train(ADDRINT ip, ADDRINT target) {
+		ADDRINT provider_pred = this->provider >= 0 ? this->entry(this->provider).target
+		                                            : this->alt_pred;
+
+		if (this->provider >= 0 && this->provider_weak && provider_pred != this->alt_pred) {
+			if (this->alt_pred == target)
+				this->use_alt_on_na += this->use_alt_on_na < 7;
+			else if (provider_pred == target)
+				this->use_alt_on_na -= this->use_alt_on_na > -8;
+		}
+
+		// allocate in a longer table on a misprediction
+		if (this->pred != target && this->provider < (int)this->num_tables - 1)
+			this->allocate(target);
+
+		if (this->provider >= 0) {
+			ITTageEntry &e = this->entry(this->provider);
+			// the base table learns too while the provider is not trusted
+			if (e.u == 0 && this->alt_provider < 0)
+				this->base[this->baseIndex(ip)] = target;
+			// replace the target only once the confidence is gone
+			if (e.target == target)
+				e.ctr += e.ctr < 3;
+			else if (e.ctr > 0)
+				e.ctr--;
+			else
+				e.target = target;
+			if (provider_pred != this->alt_pred) {
+				if (provider_pred == target)
+					e.u += e.u < 3;
+				else if (this->alt_pred == target)
+					e.u -= e.u > 0;
+			}
+		} else {
+			this->base[this->baseIndex(ip)] = target;
+		}
+
+		// periodic aging of the useful bits
+		if (++this->num_branches % ITTAGE_AGING_PERIOD == 0)
+			for (std::size_t i = 0; i < this->tables.size(); i++)
+				this->tables[i].u >>= 1;
+	}
+
+	void allocate(ADDRINT target) {
+		unsigned start = this->provider + 1;
+
+		// skip one table at random, so that allocations spread over the tables
+		this->seed ^= this->seed << 13;
+		this->seed ^= this->seed >> 17;
+		this->seed ^= this->seed << 5;
+		if ((this->seed & 1) && start + 1 < this->num_tables)
+			start++;
+
+		for (unsigned i = start; i < this->num_tables; i++) {
+			ITTageEntry &e = this->entry(i);
+			if (e.u == 0) {
+				e.valid = 1;
+				e.tag = this->tags[i];
+				e.target = target;
+				e.ctr = 0;
+				return;
+			}
+		}
+
+		// no room, make the entries a little less useful
+		for (unsigned i = this->provider + 1; i < this->num_tables; i++) {
+			ITTageEntry &e = this->entry(i);
+			e.u -= e.u > 0;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef INTERVAL_STATS_H
+#define INTERVAL_STATS_H
+
+/**
+ * Time series of the predictor counters: every interval of instructions one
+ * CSV row per predictor with the correct/incorrect predictions of that
+ * interval alone, written out as the run goes so nothing is kept in memory.
+ *
+ *   # 0: <name of predictor 0>
+ *   # ...
+ *   instructions,predictor,correct,incorrect,mpki
+ *   10000000,0,1534210,23154,2.3154
+ *
+ * "instructions" is the instruction count at the end of the interval and
+ * the MPKI is over the instructions of the interval. Predictors are numbered
+ * as in PredictorCounters.
+ **/
+
+#include <ostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "branch_predictor.h"
+#include "indirect_predictor.h"
+#include "ras.h"
+
+//> What a predictor of PredictorCounters predicts
+enum PredictorKind {
+    PREDICTOR_DIRECTION = 0,
+    PREDICTOR_BTB,
+    PREDICTOR_RAS,
+    PREDICTOR_INDIRECT,
+    PREDICTOR_NUM_KINDS
+};
+
+/**
+ * The correct/incorrect counters of every predictor under one index, in the
+ * order of PrintStats(): direction predictors, BTBs, indirect predictors and
+ * then every RAS.
+ **/
+class PredictorCounters
+{
+public:
+    void add(std::vector<BranchPredictor *> &branch_predictors,
+             std::vector<BTBPredictor *> &btb_predictors,
+             std::vector<RASGroup *> &ras_vec,
+             std::vector<IndirectPredictor *> &indirect_predictors) {
+        for (UINT32 i = 0; i < branch_predictors.size(); i++)
+            add(branch_predictors[i]->getName(), PREDICTOR_DIRECTION, branch_predictors[i], NULL, NULL);
+        for (UINT32 i = 0; i < btb_predictors.size(); i++)
+            add(btb_predictors[i]->getName(), PREDICTOR_BTB, btb_predictors[i], NULL, NULL);
+        for (UINT32 i = 0; i < indirect_predictors.size(); i++)
+            add(indirect_predictors[i]->getName(), PREDICTOR_INDIRECT, NULL, indirect_predictors[i], NULL);
+        for (UINT32 i = 0; i < ras_vec.size(); i++) {
+            const std::vector<RAS *> &stacks = ras_vec[i]->getRAS();
+            for (UINT32 j = 0; j < stacks.size(); j++) {
+                std::ostringstream name;
+                name << "RAS (" << stacks[j]->getNumEntries() << " entries)";
+                add(name.str(), PREDICTOR_RAS, NULL, NULL, stacks[j]);
+            }
+        }
+    }
+
+    UINT32 size() const { return series.size(); }
+
+    //> Names on a single line, hybrids have one line per component
+    const string &getName(UINT32 i) const { return series[i].name; }
+    PredictorKind getKind(UINT32 i) const { return series[i].kind; }
+
+    void read(UINT32 i, UINT64 &correct, UINT64 &incorrect) const {
+        const Series &s = series[i];
+        if (s.bp) {
+            correct = s.bp->getNumCorrectPredictions();
+            incorrect = s.bp->getNumIncorrectPredictions();
+        } else if (s.ibp) {
+            correct = s.ibp->getNumCorrectPredictions();
+            incorrect = s.ibp->getNumIncorrectPredictions();
+        } else {
+            correct = s.ras->getNumCorrect();
+            incorrect = s.ras->getNumIncorrect();
+        }
+    }
+
+    UINT64 getStorageBits(UINT32 i) const {
+        const Series &s = series[i];
+        if (s.bp)
+            return s.bp->getStorageBits();
+        else if (s.ibp)
+            return s.ibp->getStorageBits();
+        return s.ras->getStorageBits();
+    }
+
+private:
+    //> Exactly one of the pointers is set
+    struct Series {
+        string name;
+        PredictorKind kind;
+        BranchPredictor *bp;
+        IndirectPredictor *ibp;
+        RAS *ras;
+    };
+
+    void add(string name, PredictorKind kind, BranchPredictor *bp, IndirectPredictor *ibp, RAS *ras) {
+        std::replace(name.begin(), name.end(), '\n', ' ');
+        name.erase(name.find_last_not_of(' ') + 1);
+        Series s = { name, kind, bp, ibp, ras };
+        series.push_back(s);
+    }
+
+    std::vector<Series> series;
+};
+
+class IntervalStats
+{
+public:
+    IntervalStats(std::ostream &out, UINT64 interval_length, UINT64 start_icount = 0)
+      : out(out), interval_length(interval_length), last_icount(start_icount),
+        next_boundary(start_icount + interval_length) {};
+
+    //> Registers the predictors and writes the header, call once before sample()
+    void start(std::vector<BranchPredictor *> &branch_predictors,
+               std::vector<BTBPredictor *> &btb_predictors,
+               std::vector<RASGroup *> &ras_vec,
+               std::vector<IndirectPredictor *> &indirect_predictors) {
+        counters.add(branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+        // The counters of a resumed run do not start from 0
+        last_correct.resize(counters.size());
+        last_incorrect.resize(counters.size());
+        for (UINT32 i = 0; i < counters.size(); i++)
+            counters.read(i, last_correct[i], last_incorrect[i]);
+
+        for (UINT32 i = 0; i < counters.size(); i++)
+            out << "# " << i << ": " << counters.getName(i) << "\n";
+        out << "instructions,predictor,correct,incorrect,mpki\n";
+        out.flush();
+    }
+
+    //> First instruction count that ends an interval
+    UINT64 getNextBoundary() const { return next_boundary; }
+
+    //> Writes the rows of the interval that ends at icount and starts the next
+    void sample(UINT64 icount) {
+        UINT64 length = icount - last_icount;
+
+        for (UINT32 i = 0; i < counters.size(); i++) {
+            UINT64 correct, incorrect;
+            counters.read(i, correct, incorrect);
+            out << icount << "," << i << ","
+                << correct - last_correct[i] << "," << incorrect - last_incorrect[i] << ","
+                << (length ? (incorrect - last_incorrect[i]) * 1000.0 / length : 0.0) << "\n";
+            last_correct[i] = correct;
+            last_incorrect[i] = incorrect;
+        }
+        out.flush();
+
+        last_icount = icount;
+        while (next_boundary <= icount)
+            next_boundary += interval_length;
+    }
+
+    //> Writes the last, partial, interval if it has any instructions
+    void finish(UINT64 icount) {
+        if (icount > last_icount)
+            sample(icount);
+    }
+
+private:
+    std::ostream &out;
+    UINT64 interval_length;
+    UINT64 last_icount, next_boundary;
+    PredictorCounters counters;
+    std::vector<UINT64> last_correct, last_incorrect;
+};
+
+#endif
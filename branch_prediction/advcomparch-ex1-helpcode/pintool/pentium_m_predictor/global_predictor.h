@@ -7,12 +7,17 @@
 #include "../branch_predictor.h"
 #include "branch_predictor_return_value.h"
 #include "saturating_predictor.h"
+#include "set_assoc_table.h"
 
+template <UINT32 Ways>
 class GlobalPredictor : BranchPredictor
 {
 public:
-	GlobalPredictor(UINT32 entries, UINT32 tag_bitwidth, UINT32 ways)
-	   : m_lru_use_count(0), m_num_ways(ways), m_ways(ways, Way(entries/ways, 6)) {}
+	GlobalPredictor(UINT32 entries, UINT32 tag_bitwidth)
+	   : m_tag_bitwidth(tag_bitwidth), m_table(entries / Ways, Entry::empty())
+	{
+		assert(tag_bitwidth <= 8);
+	}
 
 	virtual bool predict(ADDRINT ip, ADDRINT target) { return 0; }
 //  BranchPredictorReturnValue lookup(ADDRINT ip, ADDRINT target) { }
@@ -25,8 +30,9 @@ public:
 		
 		gen_index_tag(ip, pir, index, tag);
 		
-		for (unsigned int w = 0 ; w < m_num_ways ; ++w )
-			if (m_ways[w].m_valid[index] && m_ways[w].m_tags[index] == tag)
+		Entry *set = m_table.ways(index);
+		for (unsigned int w = 0 ; w < Ways ; ++w )
+			if (set[w].m_valid && set[w].m_tag == tag)
 				return true;
 
 		return false;
@@ -39,10 +45,11 @@ public:
 	
 		gen_index_tag(ip, pir, index, tag);
 	
-		for (unsigned int w = 0 ; w < m_num_ways ; ++w )
-			if (m_ways[w].m_valid[index] && m_ways[w].m_tags[index] == tag) {
+		Entry *set = m_table.ways(index);
+		for (unsigned int w = 0 ; w < Ways ; ++w )
+			if (set[w].m_valid && set[w].m_tag == tag) {
 				ret.hit = 1;
-				ret.prediction = m_ways[w].m_predictors[index].predict();
+				ret.prediction = set[w].m_predictor.predict();
 				break;
 			}
 	
@@ -56,57 +63,53 @@ public:
 	
 		gen_index_tag(ip, pir, index, tag);
 	
-		// Start with way 0 as the least recently used
-		lru_way = 0;
-	
-		for (unsigned int w = 0 ; w < m_num_ways ; ++w )
+		Entry *set = m_table.ways(index);
+		for (unsigned int w = 0 ; w < Ways ; ++w )
 		{
-			if (m_ways[w].m_valid[index] && m_ways[w].m_tags[index] == tag) {
-				m_ways[w].m_predictors[index].update(actual);
-				m_ways[w].m_lru[index] = m_lru_use_count++;
+			if (set[w].m_valid && set[w].m_tag == tag) {
+				set[w].m_predictor.update(actual);
+				m_table.touch(index, w);
 				// Once we have a tag match and have updated the LRU information,
 				// we can return
 				return;
 			}
-			
-			// Keep track of the LRU in case we do not have a tag match
-			if (m_ways[w].m_lru[index] < m_ways[lru_way].m_lru[index])
-				lru_way = w;
 		}
 	
 		// We will get here only if we have not matched the tag
 		// If that is the case, select the LRU entry, and update the tag
 		// appropriately
-		m_ways[lru_way].m_valid[index] = true;
-		m_ways[lru_way].m_tags[index] = tag;
+		lru_way = m_table.victim(index);
+		set[lru_way].m_valid = true;
+		set[lru_way].m_tag = tag;
 		// Here, we miss with the tag, so reset instead of updating
-		m_ways[lru_way].m_predictors[index].reset(actual);
-		m_ways[lru_way].m_lru[index] = m_lru_use_count++;
+		set[lru_way].m_predictor.reset(actual);
+		m_table.touch(index, lru_way);
+	}
+
+	// Valid bit, tag, 2-bit counter and the LRU position of every entry
+	virtual UINT64 getStorageBits()
+	{
+		return (UINT64)m_table.getNumSets() * Ways
+		       * (1 + m_tag_bitwidth + 2 + CeilLog2(Ways));
+	}
+
+	void serialize(StateArchive &ar)
+	{
+		m_table.serialize(ar);
 	}
 
 private:
-   class Way
+   struct Entry
    {
-   public:
-
-      Way(UINT32 entries, UINT32 tag_bitwidth)
-         : m_valid(entries, false)
-         , m_tags(entries, 0)
-         , m_predictors(entries, SaturatingPredictor<2>(0))
-         , m_lru(entries, 0)
-         , m_num_entries(entries)
-         , m_tag_bitwidth(tag_bitwidth)
+      uint8_t m_valid;
+      uint8_t m_tag;
+      SaturatingPredictor<2> m_predictor;
+
+      static Entry empty()
       {
-         assert(tag_bitwidth <= 8);
+         Entry e = { 0, 0, SaturatingPredictor<2>(0) };
+         return e;
       }
-
-      std::vector<bool> m_valid;
-      std::vector<uint8_t> m_tags;
-      std::vector<SaturatingPredictor<2> > m_predictors;
-      std::vector<UINT64> m_lru;
-      UINT32 m_num_entries;
-      UINT32 m_tag_bitwidth;
-
    };
 
    // Pentium M-specific indexing and tag values
@@ -116,9 +119,8 @@ private:
       tag = ((ip >> 13) ^ pir) & 0x3F;
    }
 
-   UINT64 m_lru_use_count;
-   UINT32 m_num_ways;
-   std::vector<Way> m_ways;
+   UINT32 m_tag_bitwidth;
+   SetAssocTable<Entry, Ways, TimestampLRU> m_table;
 
 };
 
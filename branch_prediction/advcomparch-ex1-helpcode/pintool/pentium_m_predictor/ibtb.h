@@ -0,0 +1,80 @@
+#ifndef IBTB_H
+#define IBTB_H
+
+#include <vector>
+#include <cassert>
+#include <stdint.h>
+
+#include "branch_predictor_return_value.h"
+#include "../state_archive.h"
+
+class IndirectBranchTargetBuffer
+{
+public:
+   // Direct mapped and indexed by the branch address and the path
+   // information register (PIR), so the same branch can keep a target for
+   // every path that leads to it
+   IndirectBranchTargetBuffer(UINT32 entries, UINT32 tag_bitwidth)
+      : m_valid(entries, false)
+      , m_tags(entries, 0)
+      , m_targets(entries, 0)
+      , m_num_entries(entries)
+      , m_tag_bitwidth(tag_bitwidth)
+   {
+      assert(tag_bitwidth <= 16);
+   }
+
+   BranchPredictorReturnValue lookup(ADDRINT ip, ADDRINT pir)
+   {
+      UINT32 index, tag;
+      BranchPredictorReturnValue ret = { false, false, 0, BranchPredictorReturnValue::IndirectBranch };
+
+      gen_index_tag(ip, pir, index, tag);
+      if (m_valid[index] && m_tags[index] == tag)
+      {
+         ret.prediction = true;
+         ret.hit = true;
+         ret.target = m_targets[index];
+      }
+
+      return ret;
+   }
+
+   void update(ADDRINT ip, ADDRINT target, ADDRINT pir)
+   {
+      UINT32 index, tag;
+
+      gen_index_tag(ip, pir, index, tag);
+      m_valid[index] = true;
+      m_tags[index] = tag;
+      m_targets[index] = target;
+   }
+
+   void serialize(StateArchive &ar)
+   {
+      ar.io(m_valid);
+      ar.io(m_tags);
+      ar.io(m_targets);
+   }
+
+   UINT64 getStorageBits()
+   {
+      return (UINT64)m_num_entries * (1 + m_tag_bitwidth + 8 * sizeof(ADDRINT));
+   }
+
+private:
+   void gen_index_tag(ADDRINT ip, ADDRINT pir, UINT32 &index, UINT32 &tag)
+   {
+      index = ((ip >> 4) ^ pir) % m_num_entries;
+      tag = ((ip >> 4) ^ (pir >> 8) ^ (ip >> 12)) & ((1 << m_tag_bitwidth) - 1);
+   }
+
+   std::vector<bool> m_valid;
+   std::vector<uint16_t> m_tags;
+   std::vector<ADDRINT> m_targets;
+   UINT32 m_num_entries;
+   UINT32 m_tag_bitwidth;
+
+};
+
+#endif /* IBTB_H */
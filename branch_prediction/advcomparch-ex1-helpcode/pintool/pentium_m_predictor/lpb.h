@@ -7,17 +7,19 @@
 #include "../branch_predictor.h"
 #include "branch_predictor_return_value.h"
 #include "saturating_predictor.h"
+#include "set_assoc_table.h"
 
+template <UINT32 Ways>
 class LoopBranchPredictor
 {
 
 public:
 
-   LoopBranchPredictor(UINT32 entries, UINT32 tag_bitwidth, UINT32 ways)
-      : m_lru_use_count(0)
-      , m_num_ways(ways)
-      , m_ways(ways, Way(entries/ways, tag_bitwidth))
+   LoopBranchPredictor(UINT32 entries, UINT32 tag_bitwidth)
+      : m_tag_bitwidth(tag_bitwidth)
+      , m_table(entries / Ways, Entry::empty())
    {
+      assert(tag_bitwidth <= 8);
    }
 
    // Not sure if predicted can be used
@@ -37,27 +39,28 @@ public:
 
       gen_index_tag(ip, index, tag);
 
-      for (unsigned int w = 0 ; w < m_num_ways ; ++w )
+      Entry *set = m_table.ways(index);
+      for (unsigned int w = 0 ; w < Ways ; ++w )
       {
          // When we are enabled, and we hit, we can use the value even if the count isn't set to the limit
-         if ( m_ways[w].m_enabled[index]
-           && m_ways[w].m_tags[index] == tag )
+         if ( set[w].m_enabled
+           && set[w].m_tag == tag )
          {
-            UINT32 count = m_ways[w].m_count[index];
-            UINT32 limit = m_ways[w].m_limit[index];
+            UINT32 count = set[w].m_count;
+            UINT32 limit = set[w].m_limit;
 
             ret.hit = 1;
             // 000001 -> predict() == 0; 111110 -> predict() == 1
             if (count == limit)
             {
-               ret.prediction = ! m_ways[w].m_predictors[index].predict();
+               ret.prediction = ! set[w].m_predictor.predict();
             }
             else
             {
-               ret.prediction = m_ways[w].m_predictors[index].predict();
+               ret.prediction = set[w].m_predictor.predict();
             }
             // Save the lru data
-            m_ways[w].m_lru[index] = m_lru_use_count++;
+            m_table.touch(index, w);
             break;
          }
       }
@@ -73,20 +76,18 @@ public:
 
       gen_index_tag(ip, index, tag);
 
-      // Start with way 0 as the least recently used
-      lru_way = 0;
-
-      for (UINT32 w = 0 ; w < m_num_ways ; ++w )
+      Entry *set = m_table.ways(index);
+      for (UINT32 w = 0 ; w < Ways ; ++w )
       {
-         if (m_ways[w].m_tags[index] == tag)
+         if (set[w].m_tag == tag)
          {
 
-            bool current_prediction = m_ways[w].m_predictors[index].predict();
+            bool current_prediction = set[w].m_predictor.predict();
             bool match = prediction_match(w, index, actual);
-            bool previous_actual = m_ways[w].m_previous_actual[index];
-            UINT32 &next_counter = m_ways[w].m_count[index];
-            UINT32 &next_limit = m_ways[w].m_limit[index];
-            uint8_t &next_enabled = m_ways[w].m_enabled[index];
+            bool previous_actual = set[w].m_previous_actual;
+            UINT32 &next_counter = set[w].m_count;
+            UINT32 &next_limit = set[w].m_limit;
+            uint8_t &next_enabled = set[w].m_enabled;
             UINT32 current_counter = next_counter;
             UINT32 current_limit = next_limit;
             uint8_t current_enabled = next_enabled;
@@ -155,7 +156,7 @@ public:
 
                // Update the predictor
                //  For the 000001 (0) case, and we've seen two 1's, set the predictor to (1), ie. 111110
-               m_ways[w].m_predictors[index].update(actual);
+               set[w].m_predictor.update(actual);
 
                // Disable the entry since we have just started to look in another direction
                next_enabled = false;
@@ -207,63 +208,57 @@ public:
 
 
             // Update state and LRU for our next branch
-            m_ways[w].m_previous_actual[index] = actual;
-            m_ways[w].m_lru[index] = m_lru_use_count++;
+            set[w].m_previous_actual = actual;
+            m_table.touch(index, w);
             // Once we have a tag match and have updated the LRU information,
             // we can return
             return;
          }
-
-         // Keep track of the LRU in case we do not have a tag match
-         if (m_ways[w].m_lru[index] < m_ways[lru_way].m_lru[index])
-         {
-            lru_way = w;
-         }
       }
 
       // We will get here only if we have not matched the tag
       // If that is the case, select the LRU entry, and update the tag
       // appropriately
-      m_ways[lru_way].m_tags[index] = tag;
+      lru_way = m_table.victim(index);
+      set[lru_way].m_tag = tag;
       // Here, we miss with the tag, so reset instead of updating
-      m_ways[lru_way].m_predictors[index].reset(actual);
-      m_ways[lru_way].m_previous_actual[index] = actual;
-      m_ways[lru_way].m_lru[index] = m_lru_use_count++;
-      m_ways[lru_way].m_count[index] = 1;
-      m_ways[lru_way].m_limit[index] = 1;
+      set[lru_way].m_predictor.reset(actual);
+      set[lru_way].m_previous_actual = actual;
+      set[lru_way].m_count = 1;
+      set[lru_way].m_limit = 1;
+      m_table.touch(index, lru_way);
+
+   }
 
+   // Tag, previous outcome, enabled and prediction bits, the LRU position,
+   // and the count and limit at the 32 bits they are kept in here
+   UINT64 getStorageBits()
+   {
+      return (UINT64)m_table.getNumSets() * Ways
+             * (m_tag_bitwidth + 3 + CeilLog2(Ways) + 2 * 32);
+   }
+
+   void serialize(StateArchive &ar)
+   {
+      m_table.serialize(ar);
    }
 
 private:
 
-   class Way
+   struct Entry
    {
-   public:
-
-      Way(UINT32 entries, UINT32 tag_bitwidth)
-         : m_tags(entries, 0)
-         , m_previous_actual(entries, 0)
-         , m_enabled(entries, 0)
-         , m_predictors(entries, SaturatingPredictor<1>(0))
-         , m_lru(entries, 0)
-         , m_count(entries, 0)
-         , m_limit(entries, 0)
-         , m_num_entries(entries)
-         , m_tag_bitwidth(tag_bitwidth)
+      uint8_t m_tag;
+      uint8_t m_previous_actual;
+      uint8_t m_enabled;
+      SaturatingPredictor<1> m_predictor;
+      UINT32 m_count;
+      UINT32 m_limit;
+
+      static Entry empty()
       {
-         assert(tag_bitwidth <= 8);
+         Entry e = { 0, 0, 0, SaturatingPredictor<1>(0), 0, 0 };
+         return e;
       }
-
-      std::vector<uint8_t> m_tags;
-      std::vector<uint8_t> m_previous_actual;
-      std::vector<uint8_t> m_enabled;
-      std::vector<SaturatingPredictor<1> > m_predictors;
-      std::vector<UINT64> m_lru;
-      std::vector<UINT32> m_count;
-      std::vector<UINT32> m_limit;
-      UINT32 m_num_entries;
-      UINT32 m_tag_bitwidth;
-
    };
 
    // Pentium M-specific indexing and tag values
@@ -277,9 +272,9 @@ private:
    inline bool prediction_match(UINT32 way, UINT32 index, bool actual)
    {
 
-      bool prediction = m_ways[way].m_predictors[index].predict();
-      UINT32 count = m_ways[way].m_count[index];
-      UINT32 limit = m_ways[way].m_limit[index];
+      bool prediction = m_table.at(index, way).m_predictor.predict();
+      UINT32 count = m_table.at(index, way).m_count;
+      UINT32 limit = m_table.at(index, way).m_limit;
 
       // At our count limit
       if (count == limit)
@@ -303,9 +298,8 @@ private:
       }
    }
 
-   UINT64 m_lru_use_count;
-   UINT32 m_num_ways;
-   std::vector<Way> m_ways;
+   UINT32 m_tag_bitwidth;
+   SetAssocTable<Entry, Ways, TimestampLRU> m_table;
 
 };
 
@@ -7,6 +7,7 @@
 #include "pentium_m_branch_target_buffer.h"
 #include "pentium_m_bimodal_table.h"
 #include "pentium_m_loop_branch_predictor.h"
+#include "pentium_m_pir.h"
 
 #include <vector>
 
@@ -19,7 +20,10 @@ public:
 
     virtual bool predict(ADDRINT ip, ADDRINT target);
     virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target);
+    virtual void accessBatch(const BranchRecord *batch, UINT32 num_records);
     virtual string getName()  { return "Pentium-M"; }
+    virtual UINT64 getStorageBits();
+    virtual void serializeState(StateArchive &ar);
 
 private:
 
@@ -79,25 +83,45 @@ void PentiumMBranchPredictor::update(bool predicted, bool actual,
 	if (predicted != actual)
 		m_global_predictor.update(predicted, actual, ip, target, m_pir);
 
-	// TODO FIXME: Properly propagate the branch type information from the 
-	//             decoder (IndirectBranch information)
+	// Only conditional branches are predicted here, indirect branches
+	// reach the PIR from accessBatch()
 	update_pir(actual, ip, target, BranchPredictorReturnValue::ConditionalBranch);
 }
 
-void PentiumMBranchPredictor::update_pir(bool actual, ADDRINT ip, ADDRINT target,
-                            BranchPredictorReturnValue::BranchType branch_type)
+void PentiumMBranchPredictor::accessBatch(const BranchRecord *batch, UINT32 num_records)
 {
-	ADDRINT rhs;
+	for (UINT32 i = 0; i < num_records; i++) {
+		const BranchRecord &rec = batch[i];
+
+		if (rec.kind == BRANCH_COND) {
+			bool predicted = access(rec.ip, rec.target, rec.taken);
+			if (getProfile())
+				getProfile()->addPrediction(rec.ip, predicted != (bool)rec.taken);
+		} else if (IsIndirectKind(rec.kind))
+			update_pir(true, rec.ip, rec.target, BranchPredictorReturnValue::IndirectBranch);
+	}
+}
 
-	if ((branch_type == BranchPredictorReturnValue::ConditionalBranch) & actual)
-		rhs = ip >> 4;
-	else if (branch_type == BranchPredictorReturnValue::IndirectBranch)
-		rhs = (ip >> 4) | target;
-	else
-		// No PIR update
-		return;
+void PentiumMBranchPredictor::serializeState(StateArchive &ar)
+{
+	m_global_predictor.serialize(ar);
+	m_btb.serialize(ar);
+	m_bimodal_table.serialize(ar);
+	m_lpb.serialize(ar);
+	ar.io(m_pir);
+}
 
-	m_pir = ((m_pir << 2) ^ rhs) & 0x7fff;
+// The four tables and the 15-bit PIR
+UINT64 PentiumMBranchPredictor::getStorageBits()
+{
+	return m_global_predictor.getStorageBits() + m_btb.getStorageBits()
+	       + m_bimodal_table.getStorageBits() + m_lpb.getStorageBits() + 15;
+}
+
+void PentiumMBranchPredictor::update_pir(bool actual, ADDRINT ip, ADDRINT target,
+                            BranchPredictorReturnValue::BranchType branch_type)
+{
+	m_pir = PentiumMNextPIR(m_pir, actual, ip, target, branch_type);
 }
 
 #endif
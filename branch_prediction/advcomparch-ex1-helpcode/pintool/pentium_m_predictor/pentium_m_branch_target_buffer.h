@@ -5,6 +5,7 @@
 
 #include "../branch_predictor.h"
 #include "branch_predictor_return_value.h"
+#include "set_assoc_table.h"
 
 #define NUM_WAYS 4
 #define NUM_ENTRIES 512
@@ -18,22 +19,12 @@ class PentiumMBranchTargetBuffer : BranchPredictor
    // offset = ip[3:0] (4 bits)
    // index = ip[12:4] (9 bits), 512 entries
    // tag = ip[21:13] (9 bits)
-   class Way
-   {
-   public:
-      Way()
-         : m_tag_offset(NUM_ENTRIES, 0)
-         , m_plru(NUM_ENTRIES, 0)
-      {}
-
-      std::vector<UINT32> m_tag_offset; // tag and offset data
-      std::vector<UINT64> m_plru; // Should be pseudo-LRU, using LRU instead
-   };
+   // Each entry is the tag and offset data. Should be pseudo-LRU, using
+   // LRU instead
 
 public:
    PentiumMBranchTargetBuffer()
-      : m_ways(NUM_WAYS)
-      , m_lru_use_count(0)
+      : m_table(NUM_ENTRIES, 0)
    {}
 
    virtual bool predict(ADDRINT ip, ADDRINT target)
@@ -46,9 +37,10 @@ public:
       bool hit = false;
       UINT32 tag_offset = IP_TO_TAGOFF(ip);
       UINT32 index = IP_TO_INDEX(ip);
+      UINT32 *set = m_table.ways(index);
       for (UINT32 i = 0 ; i < NUM_WAYS ; i++)
       {
-         if (m_ways[i].m_tag_offset[index] == tag_offset)
+         if (set[i] == tag_offset)
          {
             hit = true;
             break;
@@ -62,39 +54,46 @@ public:
 
    virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target)
    {
-      // Start with way 0 as the least recently used
-      UINT32 lru_way = 0;
-
       UINT32 tag_offset = IP_TO_TAGOFF(ip);
       UINT32 index = IP_TO_INDEX(ip);
+      UINT32 *set = m_table.ways(index);
       for (unsigned int w = 0 ; w < NUM_WAYS ; ++w )
       {
-         if (m_ways[w].m_tag_offset[index] == tag_offset)
+         if (set[w] == tag_offset)
          {
-            m_ways[w].m_plru[index] = m_lru_use_count++;
+            m_table.touch(index, w);
             // Once we have a tag match and have updated the LRU information,
             // we can return
             return;
          }
-
-         // Keep track of the LRU in case we do not have a tag match
-         if (m_ways[w].m_plru[index] < m_ways[lru_way].m_plru[index])
-         {
-            lru_way = w;
-         }
       }
 
       // We will get here only if we have not matched the tag
       // If that is the case, select the LRU entry, and update the tag
       // appropriately
-      m_ways[lru_way].m_tag_offset[index] = tag_offset;
-      m_ways[lru_way].m_plru[index] = m_lru_use_count++;
+      UINT32 lru_way = m_table.victim(index);
+      set[lru_way] = tag_offset;
+      m_table.touch(index, lru_way);
    }
 
    virtual string getName() { return "BTB"; }
+
+   // Only the tag and offset bits and the LRU position of every entry are
+   // modelled, the targets are not
+   virtual UINT64 getStorageBits()
+   {
+      UINT32 tag_offset_bits = 0;
+      for (UINT32 mask = TAG_OFFSET_MASK ; mask ; mask >>= 1)
+         tag_offset_bits += mask & 1;
+      return (UINT64)NUM_WAYS * NUM_ENTRIES * (tag_offset_bits + CeilLog2(NUM_WAYS));
+   }
+
+   void serialize(StateArchive &ar)
+   {
+      m_table.serialize(ar);
+   }
 private:
-   std::vector<Way> m_ways;
-   UINT64 m_lru_use_count;
+   SetAssocTable<UINT32, NUM_WAYS, TimestampLRU> m_table;
 
 };
 
@@ -4,7 +4,7 @@
 #include "global_predictor.h"
 
 class PentiumMGlobalPredictor
-   : public GlobalPredictor
+   : public GlobalPredictor<4>
 {
 
 public:
@@ -14,7 +14,7 @@ public:
    // 6 tag bits per entry
    // 4-way set associative
    PentiumMGlobalPredictor()
-      : GlobalPredictor(2048, 6, 4)
+      : GlobalPredictor<4>(2048, 6)
    {}
 
 };
@@ -0,0 +1,64 @@
+#ifndef PENTIUM_M_INDIRECT_PREDICTOR_H
+#define PENTIUM_M_INDIRECT_PREDICTOR_H
+
+#include "../indirect_predictor.h"
+#include "pentium_m_indirect_branch_target_buffer.h"
+#include "pentium_m_pir.h"
+
+class PentiumMIndirectPredictor : public IndirectPredictor
+{
+   #define IP_TO_LAST_TARGET(_ip) ((_ip >> 4) & 0x1ff)
+
+public:
+   // The Pentium M iBTB, indexed with the same PIR as the global predictor.
+   // An iBTB miss falls back to the last target of the branch, as the
+   // BTB would provide it
+   PentiumMIndirectPredictor()
+      : m_pir(0)
+      , m_last_targets(512, 0)
+   {}
+
+   virtual ADDRINT predict(ADDRINT ip)
+   {
+      BranchPredictorReturnValue ibtb_out = m_ibtb.lookup(ip, m_pir);
+
+      if (ibtb_out.hit)
+         return ibtb_out.target;
+      return m_last_targets[IP_TO_LAST_TARGET(ip)];
+   }
+
+   virtual void update(ADDRINT predicted, ADDRINT ip, ADDRINT target)
+   {
+      updateCounters(predicted, target);
+      m_ibtb.update(ip, target, m_pir);
+      m_last_targets[IP_TO_LAST_TARGET(ip)] = target;
+      m_pir = PentiumMNextPIR(m_pir, true, ip, target, BranchPredictorReturnValue::IndirectBranch);
+   }
+
+   virtual void condBranch(ADDRINT ip, bool taken)
+   {
+      m_pir = PentiumMNextPIR(m_pir, taken, ip, 0, BranchPredictorReturnValue::ConditionalBranch);
+   }
+
+   virtual string getName() { return "Pentium-M-iBTB"; }
+
+   virtual void serializeState(StateArchive &ar)
+   {
+      m_ibtb.serialize(ar);
+      ar.io(m_pir);
+      ar.io(m_last_targets);
+   }
+
+   virtual UINT64 getStorageBits()
+   {
+      return m_ibtb.getStorageBits() + m_last_targets.size() * 8 * sizeof(ADDRINT) + 15;
+   }
+
+private:
+   PentiumMIndirectBranchTargetBuffer m_ibtb;
+   ADDRINT m_pir;
+   std::vector<ADDRINT> m_last_targets;
+
+};
+
+#endif /* PENTIUM_M_INDIRECT_PREDICTOR_H */
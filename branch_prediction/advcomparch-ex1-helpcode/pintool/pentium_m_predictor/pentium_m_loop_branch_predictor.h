@@ -3,7 +3,7 @@
 
 #include "lpb.h"
 
-class PentiumMLoopBranchPredictor : public LoopBranchPredictor
+class PentiumMLoopBranchPredictor : public LoopBranchPredictor<2>
 {
 
 public:
@@ -12,7 +12,7 @@ public:
    // 6 bit tag
    // 2 ways
    PentiumMLoopBranchPredictor()
-      : LoopBranchPredictor(128, 6, 2)
+      : LoopBranchPredictor<2>(128, 6)
    {}
 
 };
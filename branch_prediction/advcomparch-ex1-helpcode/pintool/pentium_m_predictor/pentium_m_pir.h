@@ -0,0 +1,25 @@
+#ifndef PENTIUM_M_PIR_H
+#define PENTIUM_M_PIR_H
+
+#include "branch_predictor_return_value.h"
+
+// The Pentium M Path Information Register (PIR), 15 bits
+// Taken conditional branches shift in their address, indirect branches
+// their address and target; other branches leave it alone
+inline ADDRINT PentiumMNextPIR(ADDRINT pir, bool actual, ADDRINT ip, ADDRINT target,
+                               BranchPredictorReturnValue::BranchType branch_type)
+{
+   ADDRINT rhs;
+
+   if ((branch_type == BranchPredictorReturnValue::ConditionalBranch) & actual)
+      rhs = ip >> 4;
+   else if (branch_type == BranchPredictorReturnValue::IndirectBranch)
+      rhs = (ip >> 4) | target;
+   else
+      // No PIR update
+      return pir;
+
+   return ((pir << 2) ^ rhs) & 0x7fff;
+}
+
+#endif /* PENTIUM_M_PIR_H */
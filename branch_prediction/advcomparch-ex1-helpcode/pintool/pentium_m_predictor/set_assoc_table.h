@@ -0,0 +1,160 @@
+#ifndef SET_ASSOC_TABLE_H
+#define SET_ASSOC_TABLE_H
+
+#include <vector>
+#include <new>
+#include <cassert>
+#include <stdint.h>
+
+#include "../state_archive.h"
+
+// Set-associative table with true LRU replacement, shared by the tagged
+// Pentium M structures
+//
+// The ways of a set and their LRU ages are stored next to each other, and
+// every set starts on a boundary of its own size rounded up to a power of
+// two (up to a cache line), so a lookup touches a single cache line.
+// Entry must be a plain struct that can be copied with memcpy.
+//
+// An age is the LRU position of a way, 0 being the most recently used.
+// Untouched ways start out older than all the others, the lowest way the
+// oldest, so the ways of a set fill in order. Recency says which touches
+// count, see TrueLRU and TimestampLRU.
+//
+// Building with -DSET_ASSOC_CHECK also keeps the LRU timestamps of every
+// way, the way the Pentium M structures used to, and asserts that victim()
+// picks the way they would have picked (the oldest stamp, the lowest way
+// on a tie). The timestamps are not saved, so the check only holds for
+// runs that do not load a snapshot.
+
+// Every touch makes the way the most recently used
+struct TrueLRU
+{
+   static const UINT64 FIRST_STAMP = 1;
+
+   bool stamp() { return true; }
+   void serialize(StateArchive &ar) {}
+};
+
+// LRU as the Pentium M structures kept it: a use count of the whole table
+// stamped on every touched entry. The count started at 0, the stamp of the
+// untouched entries too, so the first entry the table ever touches stays as
+// old as them and stamp() returns false for it.
+struct TimestampLRU
+{
+   static const UINT64 FIRST_STAMP = 0;
+
+   TimestampLRU() : m_use_count(FIRST_STAMP) {}
+
+   bool stamp() { return m_use_count++ != 0; }
+   void serialize(StateArchive &ar) { ar.io(m_use_count); }
+
+   UINT64 m_use_count;
+};
+
+template <class Entry, UINT32 Ways, class Recency = TrueLRU>
+class SetAssocTable
+{
+public:
+   SetAssocTable(UINT32 num_sets, const Entry &init)
+      : m_num_sets(num_sets)
+      , m_storage(num_sets * SET_BYTES + LINE_BYTES, 0)
+#ifdef SET_ASSOC_CHECK
+      , m_check_stamp(num_sets * Ways, 0)
+      , m_check_count(Recency::FIRST_STAMP)
+#endif
+   {
+      for (UINT32 s = 0 ; s < m_num_sets ; s++)
+      {
+         Set &set = getSet(s);
+         for (UINT32 w = 0 ; w < Ways ; w++)
+         {
+            new (&set.m_entries[w]) Entry(init);
+            set.m_age[w] = Ways - 1 - w;
+         }
+      }
+   }
+
+   UINT32 getNumSets() const { return m_num_sets; }
+
+   Entry &at(UINT32 set, UINT32 way) { return getSet(set).m_entries[way]; }
+
+   // The Ways entries of a set, way 0 first
+   Entry *ways(UINT32 set) { return getSet(set).m_entries; }
+
+   // way becomes the most recently used of its set
+   void touch(UINT32 set, UINT32 way)
+   {
+      UINT8 *age = getSet(set).m_age;
+
+#ifdef SET_ASSOC_CHECK
+      m_check_stamp[set * Ways + way] = m_check_count++;
+#endif
+      if (!m_recency.stamp())
+         return;
+      for (UINT32 w = 0 ; w < Ways ; w++)
+         if (age[w] < age[way])
+            age[w]++;
+      age[way] = 0;
+   }
+
+   // The least recently used way of a set
+   UINT32 victim(UINT32 set)
+   {
+      UINT8 *age = getSet(set).m_age;
+      UINT32 way = 0;
+
+      while (way < Ways - 1 && age[way] != Ways - 1)
+         way++;
+#ifdef SET_ASSOC_CHECK
+      const UINT64 *stamp = &m_check_stamp[set * Ways];
+      UINT32 oldest = 0;
+      for (UINT32 w = 1 ; w < Ways ; w++)
+         if (stamp[w] < stamp[oldest])
+            oldest = w;
+      assert(way == oldest);
+#endif
+      return way;
+   }
+
+   void serialize(StateArchive &ar)
+   {
+      m_recency.serialize(ar);
+      for (UINT32 s = 0 ; s < m_num_sets ; s++)
+         ar.io(getSet(s));
+   }
+
+private:
+   struct Set
+   {
+      Entry m_entries[Ways];
+      UINT8 m_age[Ways];
+   };
+
+   static const size_t LINE_BYTES = 64;
+   static const size_t SET_BYTES = sizeof(Set) <= 8 ? 8
+                                 : sizeof(Set) <= 16 ? 16
+                                 : sizeof(Set) <= 32 ? 32
+                                 : (sizeof(Set) + LINE_BYTES - 1) / LINE_BYTES * LINE_BYTES;
+
+   // Sets start at the first cache line boundary of the storage
+   Set &getSet(UINT32 s)
+   {
+      uintptr_t base = ((uintptr_t)&m_storage[0] + LINE_BYTES - 1) & ~(uintptr_t)(LINE_BYTES - 1);
+      return *(Set *)(base + s * SET_BYTES);
+   }
+
+   // The sets live at an offset into m_storage that a copy would not keep
+   SetAssocTable(const SetAssocTable &);
+   SetAssocTable &operator=(const SetAssocTable &);
+
+   UINT32 m_num_sets;
+   Recency m_recency;
+   std::vector<UINT8> m_storage;
+#ifdef SET_ASSOC_CHECK
+   std::vector<UINT64> m_check_stamp;
+   UINT64 m_check_count;
+#endif
+};
+
+#endif /* SET_ASSOC_TABLE_H */
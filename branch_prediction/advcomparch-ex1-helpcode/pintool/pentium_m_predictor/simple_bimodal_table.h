@@ -42,6 +42,13 @@ public:
 
    virtual string getName() { return "SimpleBimodal"; }
 
+   virtual UINT64 getStorageBits() { return (UINT64)m_num_entries * 2; }
+
+   void serialize(StateArchive &ar)
+   {
+      ar.io(m_table);
+   }
+
    void reset()
    {
       for (unsigned int i = 0 ; i < m_num_entries ; i++) {
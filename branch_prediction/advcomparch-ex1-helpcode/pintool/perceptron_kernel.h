@@ -0,0 +1,98 @@
+#ifndef PERCEPTRON_KERNEL_H
+#define PERCEPTRON_KERNEL_H
+
+/**
+ * Dot product and training kernels of the perceptron predictors.
+ *
+ * Weights are int8 in [-127, 127] and the history is an int8 vector of +1
+ * (taken) / -1 (not taken), zero padded to a multiple of
+ * PERCEPTRON_VECTOR_BYTES. The kernels use AVX2 or SSE2 when the compiler
+ * targets them (-mavx2, SSE2 is always there on x86-64) and plain loops
+ * otherwise; all versions give the same results.
+ **/
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define PERCEPTRON_VECTOR_BYTES 32
+
+static inline INT32 PerceptronDot(const INT8 *w, const INT8 *x, unsigned n)
+{
+    INT32 sum = 0;
+    unsigned i = 0;
+
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32) {
+        __m256i wv = _mm256_loadu_si256((const __m256i *)(w + i));
+        __m256i xv = _mm256_loadu_si256((const __m256i *)(x + i));
+        // sign extend to int16 and multiply-add pairs into int32
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+                  _mm256_cvtepi8_epi16(_mm256_castsi256_si128(wv)),
+                  _mm256_cvtepi8_epi16(_mm256_castsi256_si128(xv))));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(
+                  _mm256_cvtepi8_epi16(_mm256_extracti128_si256(wv, 1)),
+                  _mm256_cvtepi8_epi16(_mm256_extracti128_si256(xv, 1))));
+    }
+    __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    acc128 = _mm_add_epi32(acc128, _mm_shuffle_epi32(acc128, 0x4e));
+    acc128 = _mm_add_epi32(acc128, _mm_shuffle_epi32(acc128, 0xb1));
+    sum = _mm_cvtsi128_si32(acc128);
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i wv = _mm_loadu_si128((const __m128i *)(w + i));
+        __m128i xv = _mm_loadu_si128((const __m128i *)(x + i));
+        // sign extend to int16: put each byte in the high half and shift
+        __m128i wlo = _mm_srai_epi16(_mm_unpacklo_epi8(wv, wv), 8);
+        __m128i whi = _mm_srai_epi16(_mm_unpackhi_epi8(wv, wv), 8);
+        __m128i xlo = _mm_srai_epi16(_mm_unpacklo_epi8(xv, xv), 8);
+        __m128i xhi = _mm_srai_epi16(_mm_unpackhi_epi8(xv, xv), 8);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(wlo, xlo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(whi, xhi));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4e));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xb1));
+    sum = _mm_cvtsi128_si32(acc);
+#endif
+
+    for (; i < n; i++)
+        sum += w[i] * x[i];
+    return sum;
+}
+
+//> w += x when taken, w -= x when not, saturating to [-127, 127]
+static inline VOID PerceptronTrain(INT8 *w, const INT8 *x, unsigned n, bool taken)
+{
+    unsigned i = 0;
+
+#if defined(__AVX2__)
+    const __m256i min_weight = _mm256_set1_epi8(-128);
+    for (; i + 32 <= n; i += 32) {
+        __m256i wv = _mm256_loadu_si256((const __m256i *)(w + i));
+        __m256i xv = _mm256_loadu_si256((const __m256i *)(x + i));
+        wv = taken ? _mm256_adds_epi8(wv, xv) : _mm256_subs_epi8(wv, xv);
+        // -128 would break the symmetry, lift it to -127
+        wv = _mm256_sub_epi8(wv, _mm256_cmpeq_epi8(wv, min_weight));
+        _mm256_storeu_si256((__m256i *)(w + i), wv);
+    }
+#elif defined(__SSE2__)
+    const __m128i min_weight = _mm_set1_epi8(-128);
+    for (; i + 16 <= n; i += 16) {
+        __m128i wv = _mm_loadu_si128((const __m128i *)(w + i));
+        __m128i xv = _mm_loadu_si128((const __m128i *)(x + i));
+        wv = taken ? _mm_adds_epi8(wv, xv) : _mm_subs_epi8(wv, xv);
+        // -128 would break the symmetry, lift it to -127
+        wv = _mm_sub_epi8(wv, _mm_cmpeq_epi8(wv, min_weight));
+        _mm_storeu_si128((__m128i *)(w + i), wv);
+    }
+#endif
+
+    for (; i < n; i++) {
+        int v = w[i] + (taken ? x[i] : -x[i]);
+        w[i] = v > 127 ? 127 : v < -127 ? -127 : v;
+    }
+}
+
+#endif
@@ -0,0 +1,458 @@
+#ifndef PREDICTOR_ENGINE_H
+#define PREDICTOR_ENGINE_H
+
+/**
+ * Compile-time composed versions of the predictors of branch_predictor.h.
+ *
+ * An engine is a plain class with non-virtual methods:
+ *   bool lookup(ADDRINT ip, ADDRINT target)             - prediction only
+ *   void train(ADDRINT ip, ADDRINT target, bool taken)  - training only
+ *   bool access(ADDRINT ip, ADDRINT target, bool taken) - both, computing
+ *                                                          the index once
+ *   string name()
+ *   UINT64 storageBits()                                - same as getStorageBits()
+ * Combinators (TournamentEngine, Alpha21264Engine) take their components as
+ * template parameters, so a whole predictor is inlined into one function.
+ * EnginePredictor wraps an engine into the virtual BranchPredictor interface.
+ *
+ * Every engine reproduces the tables and indexing of its counterpart in
+ * branch_predictor.h exactly, so both give the same counters and names, and
+ * serialize(StateArchive &) writes the same layout as its serializeState(),
+ * so both load each other's snapshots.
+ **/
+
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+#include "branch_predictor.h"
+#include "counter_table.h"
+#include "state_archive.h"
+
+/**
+ * N-bit saturating counter state machines, same as NbitPredictor::update().
+ * Types 2-5 are the alternative 2-bit FSMs and only apply when CntrBits == 2.
+ **/
+template <unsigned CntrBits, int Type>
+struct NbitCounter {
+	static const unsigned MAX = (1 << CntrBits) - 1;
+	static const int TYPE = (CntrBits == 2) ? Type : 1;
+
+	//> The plain counter uses the branch-free update of the table
+	static void train(PackedCounterTable<CntrBits> &table, unsigned index, bool taken) {
+		if (TYPE == 1)
+			table.update(index, taken);
+		else
+			table.set(index, next(table.get(index), taken));
+	}
+
+	static std::uint8_t next(std::uint8_t c, bool taken) {
+		switch (TYPE) {
+		case 2:
+			if (taken) return c < MAX ? c + 1 : c;
+			if (c == 2) return 0;
+			return c > 0 ? c - 1 : c;
+		case 3:
+			if (taken) {
+				if (c == 1) return 3;
+				return c < MAX ? c + 1 : c;
+			}
+			return c > 0 ? c - 1 : c;
+		case 4:
+			if (taken) {
+				if (c == 1) return 3;
+				return c < MAX ? c + 1 : c;
+			}
+			if (c == 2) return 0;
+			return c > 0 ? c - 1 : c;
+		case 5:
+			if (taken) {
+				if (c == 1) return 3;
+				if (c == 3) return 2;
+				return c < MAX ? c + 1 : c;
+			}
+			return c > 0 ? c - 1 : c;
+		default:
+			if (taken) return c < MAX ? c + 1 : c;
+			return c > 0 ? c - 1 : c;
+		}
+	}
+};
+
+/**
+ * History register of HistoryBits <= 16 bits, same as HistoryRegister::value():
+ * the newest outcome enters at the top bit.
+ **/
+template <unsigned HistoryBits>
+class HistoryShifter {
+public:
+	HistoryShifter() : data(0) { }
+
+	void shift(bool taken) {
+		this->data = ((this->data >> 1) | (taken ? (1u << (HistoryBits - 1)) : 0)) & MASK;
+	}
+	std::uint16_t value() const { return this->data; }
+
+	static std::uint16_t shift(std::uint16_t h, bool taken) {
+		return ((h >> 1) | (taken ? (1u << (HistoryBits - 1)) : 0)) & MASK;
+	}
+
+	void serialize(StateArchive &ar) { serialize(ar, this->data); }
+
+	//> In the layout of a HistoryRegister of HistoryBits outcomes
+	static void serialize(StateArchive &ar, std::uint16_t &h) {
+		UINT64 recent = (UINT64)h << (64 - HistoryBits);
+		unsigned head = 0;
+		std::vector<UINT64> buffer;
+		std::vector<UINT32> folds;
+
+		ar.io(recent);
+		ar.io(head);
+		ar.io(buffer);
+		ar.io(folds);
+		if (ar.isLoading())
+			h = (recent >> (64 - HistoryBits)) & MASK;
+	}
+
+private:
+	static const std::uint16_t MASK = (1u << HistoryBits) - 1;
+	std::uint16_t data;
+};
+
+/* ===================================================================== */
+
+class AlwaysTakenEngine {
+public:
+	bool lookup(ADDRINT ip, ADDRINT target) const { return true; }
+	void train(ADDRINT ip, ADDRINT target, bool taken) { }
+	bool access(ADDRINT ip, ADDRINT target, bool taken) { return true; }
+	string name() const { return "Static AlwaysTaken"; }
+	UINT64 storageBits() const { return 0; }
+	void serialize(StateArchive &ar) { }
+};
+
+class BTFNTEngine {
+public:
+	bool lookup(ADDRINT ip, ADDRINT target) const { return ip > target; }
+	void train(ADDRINT ip, ADDRINT target, bool taken) { }
+	bool access(ADDRINT ip, ADDRINT target, bool taken) { return ip > target; }
+	string name() const { return "Static BTFNT"; }
+	UINT64 storageBits() const { return 0; }
+	void serialize(StateArchive &ar) { }
+};
+
+/**
+ * Same as NbitPredictor(IndexBits, CntrBits, Type), indexed by the low
+ * IndexBits bits of the address.
+ **/
+template <unsigned IndexBits, unsigned CntrBits, int Type = 1>
+class NbitEngine {
+public:
+	typedef NbitCounter<CntrBits, Type> Counter;
+	static const unsigned ENTRIES = 1 << IndexBits;
+
+	NbitEngine() : table(IndexBits) { }
+
+	bool lookup(ADDRINT ip, ADDRINT target) const {
+		return this->table.predict(ip & (ENTRIES - 1));
+	}
+	void train(ADDRINT ip, ADDRINT target, bool taken) {
+		Counter::train(this->table, ip & (ENTRIES - 1), taken);
+	}
+	bool access(ADDRINT ip, ADDRINT target, bool taken) {
+		unsigned index = ip & (ENTRIES - 1);
+		bool pred = this->table.predict(index);
+		Counter::train(this->table, index, taken);
+		return pred;
+	}
+
+	string name() const {
+		std::ostringstream stream;
+		stream << "Nbit-" << pow(2.0, double(IndexBits)) / 1024.0 << "K-" << CntrBits;
+		if (Counter::TYPE > 1)
+			stream << " (type=" << Counter::TYPE << ")";
+		return stream.str();
+	}
+
+	UINT64 storageBits() const { return (UINT64)ENTRIES * CntrBits; }
+
+	void serialize(StateArchive &ar) { this->table.serialize(ar); }
+
+private:
+	static_assert(CntrBits >= 1 && CntrBits <= 8, "PackedCounterTable holds up to 8 bits");
+	PackedCounterTable<CntrBits> table;
+};
+
+/**
+ * Same as GlobalHistoryPredictor(EntriesBits, NbitLength): one PHT of
+ * 2^EntriesBits NbitLength-bit counters per value of the NbitLength-bit
+ * history, i.e. a single table indexed by history:address.
+ **/
+template <unsigned EntriesBits, unsigned NbitLength>
+class GlobalHistoryEngine {
+public:
+	static const unsigned PHT_ENTRIES = 1 << EntriesBits;
+
+	GlobalHistoryEngine() : table(EntriesBits + NbitLength) { }
+
+	bool lookup(ADDRINT ip, ADDRINT target) const {
+		return this->table.predict(this->index(ip));
+	}
+	void train(ADDRINT ip, ADDRINT target, bool taken) {
+		this->table.update(this->index(ip), taken);
+		this->bhr.shift(taken);
+	}
+	bool access(ADDRINT ip, ADDRINT target, bool taken) {
+		unsigned index = this->index(ip);
+		bool pred = this->table.predict(index);
+		this->table.update(index, taken);
+		this->bhr.shift(taken);
+		return pred;
+	}
+
+	string name() const {
+		std::ostringstream stream;
+		stream << "Global History Two Level Predictor (entries=" << PHT_ENTRIES
+		       << ", nbit=" << NbitLength << ")";
+		return stream.str();
+	}
+
+	UINT64 storageBits() const {
+		return ((UINT64)PHT_ENTRIES << NbitLength) * NbitLength + NbitLength;
+	}
+
+	void serialize(StateArchive &ar) {
+		this->bhr.serialize(ar);
+		this->table.serialize(ar);
+	}
+
+private:
+	unsigned index(ADDRINT ip) const {
+		return ((unsigned)this->bhr.value() << EntriesBits) | (ip & (PHT_ENTRIES - 1));
+	}
+
+	HistoryShifter<NbitLength> bhr;
+	PackedCounterTable<NbitLength> table;
+};
+
+/**
+ * Same as LocalHistoryPredictor(BhtEntryBits, BhtLength, PhtEntryBits,
+ * PhtLength): the PHT is indexed by the address bits above the history
+ * concatenated with the branch's local history.
+ **/
+template <unsigned BhtEntryBits, unsigned BhtLength,
+          unsigned PhtEntryBits = 13, unsigned PhtLength = 2>
+class LocalHistoryEngine {
+public:
+	static const unsigned BHT_ENTRIES = 1 << BhtEntryBits;
+	static const unsigned PHT_ENTRIES = 1 << PhtEntryBits;
+
+	LocalHistoryEngine() : pht(PhtEntryBits) {
+		memset(this->bht, 0, sizeof(this->bht));
+	}
+
+	bool lookup(ADDRINT ip, ADDRINT target) const {
+		return this->pht.predict(this->phtIndex(ip, this->bht[ip & (BHT_ENTRIES - 1)]));
+	}
+	void train(ADDRINT ip, ADDRINT target, bool taken) {
+		std::uint16_t &h = this->bht[ip & (BHT_ENTRIES - 1)];
+		this->pht.update(this->phtIndex(ip, h), taken);
+		h = HistoryShifter<BhtLength>::shift(h, taken);
+	}
+	bool access(ADDRINT ip, ADDRINT target, bool taken) {
+		std::uint16_t &h = this->bht[ip & (BHT_ENTRIES - 1)];
+		unsigned index = this->phtIndex(ip, h);
+		bool pred = this->pht.predict(index);
+		this->pht.update(index, taken);
+		h = HistoryShifter<BhtLength>::shift(h, taken);
+		return pred;
+	}
+
+	string name() const {
+		std::ostringstream stream;
+		stream << "Local History Two Level Predictor(BHT entries=" << BHT_ENTRIES
+		       << ", BHT length=" << BhtLength << ")";
+		return stream.str();
+	}
+
+	UINT64 storageBits() const {
+		return (UINT64)BHT_ENTRIES * BhtLength + (UINT64)PHT_ENTRIES * PhtLength;
+	}
+
+	void serialize(StateArchive &ar) {
+		this->pht.serialize(ar);
+		for (unsigned i = 0; i < BHT_ENTRIES; i++)
+			HistoryShifter<BhtLength>::serialize(ar, this->bht[i]);
+	}
+
+private:
+	static_assert(PhtEntryBits >= BhtLength, "the PHT index must hold the whole history");
+
+	static unsigned phtIndex(ADDRINT ip, std::uint16_t history) {
+		std::uint16_t pc_part = ip & ((1u << (PhtEntryBits - BhtLength)) - 1);
+		std::uint16_t custom_ip = (pc_part << BhtLength) | history;
+		return custom_ip & (PHT_ENTRIES - 1);
+	}
+
+	std::uint16_t bht[BHT_ENTRIES];
+	PackedCounterTable<PhtLength> pht;
+};
+
+/**
+ * Same as TournamentHybridPredictor(MetaBits, new P0, new P1): a 2-bit meta
+ * predictor per address picks P1 when set. Both components are trained on
+ * every branch and the meta predictor moves towards the one that was right.
+ **/
+template <unsigned MetaBits, class P0, class P1>
+class TournamentEngine {
+public:
+	bool lookup(ADDRINT ip, ADDRINT target) const {
+		return this->meta.lookup(ip, target) ? this->pred1.lookup(ip, target)
+		                                     : this->pred0.lookup(ip, target);
+	}
+	void train(ADDRINT ip, ADDRINT target, bool taken) {
+		this->access(ip, target, taken);
+	}
+	bool access(ADDRINT ip, ADDRINT target, bool taken) {
+		bool choice = this->meta.lookup(ip, target);
+		bool p0 = this->pred0.access(ip, target, taken);
+		bool p1 = this->pred1.access(ip, target, taken);
+
+		if (p0 != p1)
+			this->meta.train(ip, target, p1 == taken);
+		return choice ? p1 : p0;
+	}
+
+	string name() const {
+		std::ostringstream stream;
+		stream << "Tournament Hyprid Predictor\n"
+		       << "| Meta : " << this->meta.name() << '\n'
+		       << "| Pred0: " << this->pred0.name() << '\n'
+		       << "| Pred1: " << this->pred1.name() << '\n';
+		return stream.str();
+	}
+
+	UINT64 storageBits() const {
+		return this->meta.storageBits() + this->pred0.storageBits() + this->pred1.storageBits();
+	}
+
+	void serialize(StateArchive &ar) {
+		this->meta.serialize(ar);
+		this->pred0.serialize(ar);
+		this->pred1.serialize(ar);
+	}
+
+private:
+	NbitEngine<MetaBits, 2> meta;
+	P0 pred0;
+	P1 pred1;
+};
+
+/**
+ * Alpha 21264 style choice between a local (Local) and a global (Global)
+ * predictor, driven by a HistoryBits-bit global history. As in Alpha21264,
+ * the choice and global tables are looked up with the global history in
+ * place of the address but trained at the branch address.
+ **/
+template <unsigned ChoiceBits, unsigned HistoryBits, class Local, class Global>
+class AlphaChoiceEngine {
+public:
+	bool lookup(ADDRINT ip, ADDRINT target) const {
+		std::uint16_t history = this->global_history.value();
+		return this->choice.lookup(history, 0) ? this->global.lookup(history, target)
+		                                       : this->local.lookup(ip, target);
+	}
+	void train(ADDRINT ip, ADDRINT target, bool taken) {
+		this->access(ip, target, taken);
+	}
+	bool access(ADDRINT ip, ADDRINT target, bool taken) {
+		std::uint16_t history = this->global_history.value();
+		bool choice = this->choice.lookup(history, 0); // it does not use the target
+		bool p0 = this->local.access(ip, target, taken);
+		bool p1 = this->global.lookup(history, target);
+
+		if (p0 != p1)
+			this->choice.train(ip, target, p1 == taken);
+		this->global.train(ip, target, taken);
+		this->global_history.shift(taken);
+		return choice ? p1 : p0;
+	}
+
+	string name() const { return "Alpha 21264"; }
+
+	UINT64 storageBits() const {
+		return HistoryBits + this->choice.storageBits() + this->local.storageBits()
+		       + this->global.storageBits();
+	}
+
+	//> Same order as Alpha21264
+	void serialize(StateArchive &ar) {
+		this->global_history.serialize(ar);
+		this->global.serialize(ar);
+		this->local.serialize(ar);
+		this->choice.serialize(ar);
+	}
+
+private:
+	HistoryShifter<HistoryBits> global_history;
+	NbitEngine<ChoiceBits, 2> choice;
+	Local local;
+	Global global;
+};
+
+//> Same configuration as Alpha21264
+typedef AlphaChoiceEngine<12, 12, LocalHistoryEngine<10, 10, 10, 3>,
+                          GlobalHistoryEngine<12, 2> > Alpha21264Engine;
+
+/* ===================================================================== */
+
+/**
+ * Adapts an engine to the virtual BranchPredictor interface. The engine can
+ * be large, so the adapter is always allocated with new, like the other
+ * predictors.
+ **/
+template <class Engine>
+class EnginePredictor : public BranchPredictor {
+public:
+	EnginePredictor() : BranchPredictor() { }
+	~EnginePredictor() { }
+
+	virtual bool predict(ADDRINT ip, ADDRINT target) {
+		return this->engine.lookup(ip, target);
+	}
+
+	virtual void update(bool predicted, bool actual, ADDRINT ip, ADDRINT target) {
+		this->engine.train(ip, target, actual);
+		updateCounters(predicted, actual);
+	}
+
+	virtual bool access(ADDRINT ip, ADDRINT target, bool actual) {
+		bool predicted = this->engine.access(ip, target, actual);
+		updateCounters(predicted, actual);
+		return predicted;
+	}
+
+	virtual void accessBatch(const BranchRecord *batch, UINT32 num_records) {
+		for (UINT32 i = 0; i < num_records; i++) {
+			const BranchRecord &rec = batch[i];
+			if (rec.kind != BRANCH_COND)
+				continue;
+			bool predicted = this->engine.access(rec.ip, rec.target, rec.taken);
+			updateCounters(predicted, rec.taken);
+			if (this->getProfile())
+				this->getProfile()->addPrediction(rec.ip, predicted != (bool)rec.taken);
+		}
+	}
+
+	virtual string getName() { return this->engine.name(); }
+
+	virtual UINT64 getStorageBits() { return this->engine.storageBits(); }
+
+	virtual void serializeState(StateArchive &ar) { this->engine.serialize(ar); }
+
+private:
+	Engine engine;
+};
+
+#endif
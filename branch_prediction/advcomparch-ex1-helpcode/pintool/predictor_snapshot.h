@@ -0,0 +1,271 @@
+#ifndef PREDICTOR_SNAPSHOT_H
+#define PREDICTOR_SNAPSHOT_H
+
+/**
+ * Snapshots of the state of a set of predictors, to warm up the predictors
+ * of a later run (from another region or input) or to resume a run.
+ *
+ * File layout (all integers little endian):
+ *
+ *   SnapshotHeader
+ *   entry 0: SnapshotEntry, name, state image, counters image
+ *   entry 1: ...
+ *
+ * Every predictor, BTB, indirect predictor and RAS group is one entry, in the
+ * order of PredictorCounters. The state image is what serializeState()
+ * writes (tables, histories, replacement state), the counters image what
+ * serializeCounters() writes. Entries are matched to the predictors of the
+ * run by kind and name, the n-th predictor of a name taking the n-th entry of
+ * that name, so the two runs do not need the same predictor set: predictors
+ * without an entry stay cold and entries without a predictor are ignored.
+ **/
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "branch_predictor.h"
+#include "indirect_predictor.h"
+#include "ras.h"
+#include "state_archive.h"
+
+#define PREDICTOR_SNAPSHOT_MAGIC   "CSLBSNP"
+#define PREDICTOR_SNAPSHOT_VERSION 2
+
+struct SnapshotHeader {
+    char magic[8];
+    UINT32 version;
+    UINT32 num_entries;
+    UINT64 icount;       // instruction count the snapshot was taken at
+    UINT64 instructions; // instructions behind the counters
+};
+
+enum SnapshotKind {
+    SNAPSHOT_BRANCH = 0,
+    SNAPSHOT_BTB,
+    SNAPSHOT_INDIRECT,
+    SNAPSHOT_RAS
+};
+
+struct SnapshotEntry {
+    UINT32 kind;         // SnapshotKind
+    UINT32 name_bytes;
+    UINT64 state_bytes;
+    UINT64 counter_bytes;
+};
+
+class PredictorSnapshot
+{
+public:
+    PredictorSnapshot() : icount(0), instructions(0) {};
+
+    //> Takes the snapshot of the given predictors
+    void capture(std::vector<BranchPredictor *> &branch_predictors,
+                 std::vector<BTBPredictor *> &btb_predictors,
+                 std::vector<RASGroup *> &ras_vec,
+                 std::vector<IndirectPredictor *> &indirect_predictors,
+                 UINT64 icount_, UINT64 instructions_) {
+        std::vector<Slot> slots;
+
+        GetSlots(branch_predictors, btb_predictors, ras_vec, indirect_predictors, slots);
+        entries.clear();
+        for (UINT32 i = 0; i < slots.size(); i++) {
+            StateArchive state, counters;
+            Slot::serialize(slots[i], state, counters);
+            Entry e = { slots[i].kind, slots[i].name, state.getData(), counters.getData() };
+            entries.push_back(e);
+        }
+        icount = icount_;
+        instructions = instructions_;
+    }
+
+    /**
+     * Loads the snapshot into the given predictors, the counters too when
+     * with_counters is set. Fails when an entry does not fit the predictor
+     * of its name, e.g. a table of another size.
+     **/
+    bool restore(std::vector<BranchPredictor *> &branch_predictors,
+                 std::vector<BTBPredictor *> &btb_predictors,
+                 std::vector<RASGroup *> &ras_vec,
+                 std::vector<IndirectPredictor *> &indirect_predictors,
+                 bool with_counters, UINT32 &num_restored, string &error) const {
+        std::vector<Slot> slots;
+        std::vector<bool> used(entries.size(), false);
+
+        GetSlots(branch_predictors, btb_predictors, ras_vec, indirect_predictors, slots);
+        num_restored = 0;
+        for (UINT32 i = 0; i < slots.size(); i++) {
+            UINT32 e = 0;
+            while (e < entries.size()
+                   && (used[e] || entries[e].kind != slots[i].kind || entries[e].name != slots[i].name))
+                e++;
+            if (e == entries.size())
+                continue;
+            used[e] = true;
+
+            StateArchive state(entries[e].state);
+            StateArchive counters(entries[e].counters);
+            Slot::serialize(slots[i], state, counters, with_counters);
+            if (!state.done() || (with_counters && !counters.done())) {
+                error = "the snapshot of " + slots[i].name + " does not fit it";
+                return false;
+            }
+            num_restored++;
+        }
+        return true;
+    }
+
+    UINT64 getICount() const { return icount; }
+    UINT64 getInstructions() const { return instructions; }
+
+    bool write(const string &path, string &error) const {
+        FILE *fp = fopen(path.c_str(), "wb");
+        SnapshotHeader hdr;
+        bool ok;
+
+        if (!fp) {
+            error = "cannot write " + path;
+            return false;
+        }
+        memset(&hdr, 0, sizeof(hdr));
+        strncpy(hdr.magic, PREDICTOR_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+        hdr.version = PREDICTOR_SNAPSHOT_VERSION;
+        hdr.num_entries = entries.size();
+        hdr.icount = icount;
+        hdr.instructions = instructions;
+        ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+
+        for (UINT32 i = 0; ok && i < entries.size(); i++) {
+            const Entry &e = entries[i];
+            SnapshotEntry se = { e.kind, (UINT32)e.name.size(), e.state.size(), e.counters.size() };
+            ok = fwrite(&se, sizeof(se), 1, fp) == 1
+                 && fwrite(e.name.data(), 1, e.name.size(), fp) == e.name.size()
+                 && fwrite(e.state.data(), 1, e.state.size(), fp) == e.state.size()
+                 && fwrite(e.counters.data(), 1, e.counters.size(), fp) == e.counters.size();
+        }
+        if (fclose(fp) != 0)
+            ok = false;
+        if (!ok)
+            error = "cannot write " + path;
+        return ok;
+    }
+
+    bool read(const string &path, string &error) {
+        FILE *fp = fopen(path.c_str(), "rb");
+        SnapshotHeader hdr;
+        bool ok;
+
+        if (!fp) {
+            error = "cannot read " + path;
+            return false;
+        }
+        ok = fread(&hdr, sizeof(hdr), 1, fp) == 1
+             && strncmp(hdr.magic, PREDICTOR_SNAPSHOT_MAGIC, sizeof(hdr.magic)) == 0;
+        if (ok && hdr.version != PREDICTOR_SNAPSHOT_VERSION) {
+            fclose(fp);
+            std::ostringstream msg;
+            msg << path << " is a version " << hdr.version << " snapshot, expected version "
+                << PREDICTOR_SNAPSHOT_VERSION;
+            error = msg.str();
+            return false;
+        }
+
+        entries.clear();
+        for (UINT32 i = 0; ok && i < hdr.num_entries; i++) {
+            SnapshotEntry se;
+            Entry e;
+            ok = fread(&se, sizeof(se), 1, fp) == 1;
+            if (!ok)
+                break;
+            e.kind = se.kind;
+            e.name.resize(se.name_bytes);
+            e.state.resize(se.state_bytes);
+            e.counters.resize(se.counter_bytes);
+            ok = ReadBytes(fp, &e.name[0], se.name_bytes)
+                 && ReadBytes(fp, e.state.data(), se.state_bytes)
+                 && ReadBytes(fp, e.counters.data(), se.counter_bytes);
+            entries.push_back(e);
+        }
+        fclose(fp);
+        if (!ok) {
+            error = path + " is not a predictor snapshot or is truncated";
+            return false;
+        }
+        icount = hdr.icount;
+        instructions = hdr.instructions;
+        return true;
+    }
+
+private:
+    struct Entry {
+        UINT32 kind;
+        string name;
+        std::vector<UINT8> state, counters;
+    };
+
+    //> One predictor of the run, exactly one of the pointers is set
+    struct Slot {
+        UINT32 kind;
+        string name;
+        BranchPredictor *bp;
+        IndirectPredictor *ibp;
+        RASGroup *ras;
+
+        static void serialize(const Slot &s, StateArchive &state, StateArchive &counters,
+                              bool with_counters = true) {
+            if (s.bp) {
+                s.bp->serializeState(state);
+                if (with_counters)
+                    s.bp->serializeCounters(counters);
+            } else if (s.ibp) {
+                s.ibp->serializeState(state);
+                if (with_counters)
+                    s.ibp->serializeCounters(counters);
+            } else {
+                s.ras->serializeState(state);
+                if (with_counters)
+                    s.ras->serializeCounters(counters);
+            }
+        }
+    };
+
+    static void GetSlots(std::vector<BranchPredictor *> &branch_predictors,
+                         std::vector<BTBPredictor *> &btb_predictors,
+                         std::vector<RASGroup *> &ras_vec,
+                         std::vector<IndirectPredictor *> &indirect_predictors,
+                         std::vector<Slot> &slots) {
+        for (UINT32 i = 0; i < branch_predictors.size(); i++) {
+            Slot s = { SNAPSHOT_BRANCH, branch_predictors[i]->getName(), branch_predictors[i], NULL, NULL };
+            slots.push_back(s);
+        }
+        for (UINT32 i = 0; i < btb_predictors.size(); i++) {
+            Slot s = { SNAPSHOT_BTB, btb_predictors[i]->getName(), btb_predictors[i], NULL, NULL };
+            slots.push_back(s);
+        }
+        for (UINT32 i = 0; i < indirect_predictors.size(); i++) {
+            Slot s = { SNAPSHOT_INDIRECT, indirect_predictors[i]->getName(), NULL, indirect_predictors[i], NULL };
+            slots.push_back(s);
+        }
+        for (UINT32 i = 0; i < ras_vec.size(); i++) {
+            const std::vector<RAS *> &stacks = ras_vec[i]->getRAS();
+            std::ostringstream name;
+            name << "RAS group (entries=";
+            for (UINT32 j = 0; j < stacks.size(); j++)
+                name << (j ? "," : "") << stacks[j]->getNumEntries();
+            name << ")";
+            Slot s = { SNAPSHOT_RAS, name.str(), NULL, NULL, ras_vec[i] };
+            slots.push_back(s);
+        }
+    }
+
+    static bool ReadBytes(FILE *fp, void *p, UINT64 n) {
+        return n == 0 || fread(p, 1, n, fp) == n;
+    }
+
+    std::vector<Entry> entries;
+    UINT64 icount, instructions;
+};
+
+#endif
@@ -0,0 +1,629 @@
+#ifndef PREDICTOR_SPEC_H
+#define PREDICTOR_SPEC_H
+
+/**
+ * Builds the simulated predictors from textual specs, so that a single run
+ * can sweep a whole design space without editing InitPredictors():
+ *
+ *   tournament(11, nbit(13, 2), local(12, 2, 12, 2)); btb(512, 1..8)
+ *
+ * Specs are separated by ';' or new lines and '#' starts a comment. Any
+ * number can be a range lo..hi; a spec with ranges stands for every
+ * combination of their values, so nbit(10..16, 1..4) builds 28 predictors.
+ * Every argument is checked against its legal values (CheckSpecArgs()),
+ * so a sweep that reaches a bad one, as btb(512, 1..8) does with 3 ways,
+ * stops with an error that names the configuration.
+ *
+ * Direction predictors:
+ *   always_taken, btfnt, pentium_m, alpha21264
+ *   nbit(index_bits, cntr_bits [, fsm_type])
+ *   global(entries_bits, nbit_length)
+ *   gconcat|gselect|gshare|gfolded(index_bits, history_length, cntr_bits)
+ *   local(bht_bits, bht_length [, pht_bits, pht_length])
+ *   tournament(meta_bits, pred0, pred1)
+ *   hybrid(table_bits, meta_pc|meta_ghist|priority|adder, pred0, pred1 [, ...])
+ *   loop(entries, ways, tag_bits, iter_bits, confidence, base)
+ *   tage(storage_kbits)
+ *   tage(tables, log_entries, tag_bits, min_history, max_history, log_bimodal)
+ *   perceptron(entries_bits, history_length)
+ *   hashed_perceptron(tables, entries_bits, max_history)
+ * BTBs:
+ *   btb(lines, assoc [, lru|plru|random])
+ * Return address stacks, all of them share one RASGroup:
+ *   ras(entries)
+ * Indirect target predictors:
+ *   ibtb(index_bits [, history_bits]), pentium_m_ibtb
+ *   ittage(tables, log_entries, tag_bits, min_history, max_history, log_base)
+ * The built-in configurations of branch_sim.h:
+ *   default_predictors, default_btbs, default_ras, default_indirect
+ *
+ * budget(bits) drops every predictor, BTB, indirect predictor and RAS of
+ * the specs that needs more than bits of storage (getStorageBits()), so a
+ * sweep only simulates the configurations that fit:
+ *
+ *   budget(32768); nbit(10..16, 1..4); gshare(10..14, 8..16, 2)
+ *
+ * The budget applies to all the specs of the text, wherever it is. The
+ * stacks of default_ras and the predictors already in the vectors are kept
+ * whatever their size.
+ *
+ * The predictors are built from the classes of branch_predictor.h, which
+ * give the same results as the predictor_engine.h templates of the default
+ * configuration.
+ **/
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "branch_sim.h"
+
+// Refuse sweeps that would build more predictors than this
+#define PREDICTOR_SPEC_MAX_EXPANSION 100000
+
+class PredictorSpec
+{
+public:
+    PredictorSpec() : lo(0), hi(0) {};
+
+    string name;                    // empty for a number
+    INT64 lo, hi;                   // values of a number, lo == hi unless a range
+    std::vector<PredictorSpec> args;
+
+    bool isNumber() const { return name.empty(); }
+
+    string toString() const {
+        std::ostringstream stream;
+
+        if (isNumber()) {
+            stream << lo;
+            if (hi != lo)
+                stream << ".." << hi;
+            return stream.str();
+        }
+
+        stream << name;
+        if (!args.empty()) {
+            stream << "(";
+            for (UINT32 i = 0; i < args.size(); i++)
+                stream << (i ? ", " : "") << args[i].toString();
+            stream << ")";
+        }
+        return stream.str();
+    }
+};
+
+/**
+ * Recursive descent parser of the spec grammar:
+ *   list  := spec { (';' | '\n') spec }
+ *   spec  := name [ '(' arg { ',' arg } ')' ]
+ *   arg   := spec | number [ '..' number ]
+ **/
+class PredictorSpecParser
+{
+public:
+    PredictorSpecParser(const string &text_) : text(text_), pos(0), line(1), depth(0) {};
+
+    bool parse(std::vector<PredictorSpec> &specs) {
+        while (true) {
+            skipSpace(true);
+            if (pos == text.size())
+                return true;
+
+            PredictorSpec spec;
+            if (!parseSpec(spec))
+                return false;
+            specs.push_back(spec);
+
+            skipSpace(false);
+            if (pos < text.size() && text[pos] != ';' && text[pos] != '\n')
+                return fail("expected ';' or a new line after a spec");
+        }
+    }
+
+    const string &getError() const { return error; }
+
+private:
+    bool parseSpec(PredictorSpec &spec) {
+        skipSpace(false);
+        while (pos < text.size() && (isalnum((unsigned char)text[pos]) || text[pos] == '_'))
+            spec.name += text[pos++];
+        if (spec.name.empty() || isdigit((unsigned char)spec.name[0]))
+            return fail("expected a predictor name");
+
+        skipSpace(false);
+        if (pos == text.size() || text[pos] != '(')
+            return true;
+        pos++;
+        depth++;
+
+        while (true) {
+            PredictorSpec arg;
+
+            skipSpace(false);
+            if (pos < text.size() && (isdigit((unsigned char)text[pos]) || text[pos] == '-')) {
+                if (!parseNumber(arg))
+                    return false;
+            } else if (!parseSpec(arg)) {
+                return false;
+            }
+            spec.args.push_back(arg);
+
+            skipSpace(false);
+            if (pos < text.size() && text[pos] == ',') {
+                pos++;
+                continue;
+            }
+            if (pos < text.size() && text[pos] == ')') {
+                pos++;
+                depth--;
+                return true;
+            }
+            return fail("expected ',' or ')'");
+        }
+    }
+
+    bool parseNumber(PredictorSpec &arg) {
+        const char *start = text.c_str() + pos;
+        char *end;
+
+        arg.lo = arg.hi = strtoll(start, &end, 0);
+        if (end == start)
+            return fail("expected a number");
+        pos += end - start;
+
+        if (text.compare(pos, 2, "..") == 0) {
+            start = text.c_str() + pos + 2;
+            arg.hi = strtoll(start, &end, 0);
+            if (end == start)
+                return fail("expected the end of the range");
+            pos = end - text.c_str();
+            if (arg.hi < arg.lo)
+                return fail("empty range");
+        }
+        return true;
+    }
+
+    //> Skips blanks and comments, and also new lines and ';' between specs.
+    //  New lines inside parentheses are blanks.
+    void skipSpace(bool separators) {
+        while (pos < text.size()) {
+            char c = text[pos];
+            if (c == '#') {
+                while (pos < text.size() && text[pos] != '\n')
+                    pos++;
+            } else if (c == '\n' && !separators && depth == 0) {
+                return;
+            } else if (c == ';' && !separators) {
+                return;
+            } else if (isspace((unsigned char)c) || c == ';') {
+                line += (c == '\n');
+                pos++;
+            } else {
+                return;
+            }
+        }
+    }
+
+    bool fail(const char *what) {
+        std::ostringstream stream;
+        stream << "line " << line << ": " << what << " at \""
+               << text.substr(pos, 20) << "\"";
+        error = stream.str();
+        return false;
+    }
+
+    const string &text;
+    size_t pos;
+    UINT32 line;
+    UINT32 depth;   // open parentheses
+    string error;
+};
+
+//> Every combination of the ranges in spec, appended to out
+inline bool ExpandPredictorSpec(const PredictorSpec &spec, std::vector<PredictorSpec> &out)
+{
+    if (spec.isNumber()) {
+        if (spec.hi - spec.lo >= PREDICTOR_SPEC_MAX_EXPANSION)
+            return false;
+        for (INT64 v = spec.lo; v <= spec.hi; v++) {
+            PredictorSpec value;
+            value.lo = value.hi = v;
+            out.push_back(value);
+        }
+        return true;
+    }
+
+    std::vector<PredictorSpec> combos(1, spec);
+    combos[0].args.clear();
+    for (UINT32 i = 0; i < spec.args.size(); i++) {
+        std::vector<PredictorSpec> values, next;
+
+        if (!ExpandPredictorSpec(spec.args[i], values))
+            return false;
+        if ((UINT64)combos.size() * values.size() > PREDICTOR_SPEC_MAX_EXPANSION)
+            return false;
+        for (UINT32 c = 0; c < combos.size(); c++) {
+            for (UINT32 v = 0; v < values.size(); v++) {
+                next.push_back(combos[c]);
+                next.back().args.push_back(values[v]);
+            }
+        }
+        combos.swap(next);
+    }
+
+    out.insert(out.end(), combos.begin(), combos.end());
+    return true;
+}
+
+//> Deletes the predictors from first on that need more than budget_bits
+template <class Predictor>
+inline void DropOverBudget(std::vector<Predictor *> &predictors, UINT32 first, UINT64 budget_bits)
+{
+    UINT32 kept = first;
+
+    for (UINT32 i = first; i < predictors.size(); i++) {
+        if (predictors[i]->getStorageBits() <= budget_bits)
+            predictors[kept++] = predictors[i];
+        else
+            delete predictors[i];
+    }
+    predictors.resize(kept);
+}
+
+/* ===================================================================== */
+
+//> Checks that spec has min_args to max_args arguments, all of them numbers
+//  except the ones from first_spec_arg on
+inline bool CheckSpecArgs(const PredictorSpec &spec, UINT32 min_args, UINT32 max_args,
+                          string &error, UINT32 first_spec_arg = ~0u)
+{
+    std::ostringstream stream;
+
+    if (spec.args.size() < min_args || spec.args.size() > max_args) {
+        stream << spec.name << " takes ";
+        if (min_args == max_args)
+            stream << min_args;
+        else
+            stream << min_args << " to " << max_args;
+        stream << " arguments: " << spec.toString();
+        error = stream.str();
+        return false;
+    }
+    for (UINT32 i = 0; i < spec.args.size(); i++) {
+        if (spec.args[i].isNumber() != (i < first_spec_arg)) {
+            stream << "argument " << i + 1 << " of " << spec.name << " must be "
+                   << (i < first_spec_arg ? "a number" : "a predictor") << ": " << spec.toString();
+            error = stream.str();
+            return false;
+        }
+    }
+    return true;
+}
+
+//> Legal values of a numeric spec argument
+struct SpecRange {
+    INT64 lo, hi;
+    const char *what;
+};
+
+// hi of a SpecRange that only has a lower limit
+#define SPEC_NO_LIMIT 0x7fffffffffffffffLL
+
+/**
+ * Checks that spec has min_args to max_args arguments, that the first N are
+ * numbers within ranges and that the others are predictors (or names).
+ * Every constructor argument is checked here, so that a bad spec, or a
+ * sweep that reaches a bad value, stops with an error that names it
+ * instead of crashing in a constructor.
+ **/
+template <UINT32 N>
+inline bool CheckSpecArgs(const PredictorSpec &spec, UINT32 min_args, UINT32 max_args,
+                          const SpecRange (&ranges)[N], string &error)
+{
+    if (!CheckSpecArgs(spec, min_args, max_args, error, N))
+        return false;
+    for (UINT32 i = 0; i < N && i < spec.args.size(); i++) {
+        if (spec.args[i].lo < ranges[i].lo || spec.args[i].hi > ranges[i].hi) {
+            std::ostringstream stream;
+            stream << ranges[i].what << " of " << spec.name << " must be ";
+            if (ranges[i].hi == SPEC_NO_LIMIT)
+                stream << "at least " << ranges[i].lo;
+            else
+                stream << ranges[i].lo << " to " << ranges[i].hi;
+            stream << ": " << spec.toString();
+            error = stream.str();
+            return false;
+        }
+    }
+    return true;
+}
+
+//> Sets error to what is wrong with spec and returns false
+inline bool SpecError(const PredictorSpec &spec, const string &what, string &error)
+{
+    error = spec.name + " " + what + ": " + spec.toString();
+    return false;
+}
+
+//> Builds the direction predictor of a spec without ranges, NULL on errors
+inline BranchPredictor *BuildBranchPredictor(const PredictorSpec &spec, string &error)
+{
+    const string &n = spec.name;
+    std::vector<INT64> a;
+
+    for (UINT32 i = 0; i < spec.args.size(); i++)
+        a.push_back(spec.args[i].lo);
+
+    if (n == "always_taken") {
+        if (CheckSpecArgs(spec, 0, 0, error))
+            return new AlwaysTakenPredictor();
+    } else if (n == "btfnt") {
+        if (CheckSpecArgs(spec, 0, 0, error))
+            return new BTFNTPredictor();
+    } else if (n == "pentium_m") {
+        if (CheckSpecArgs(spec, 0, 0, error))
+            return new PentiumMBranchPredictor();
+    } else if (n == "alpha21264") {
+        if (CheckSpecArgs(spec, 0, 0, error))
+            return new Alpha21264();
+    } else if (n == "nbit") {
+        static const SpecRange ranges[] = {
+            { 1, 30, "index bits" }, { 1, 8, "counter bits" }, { 1, 5, "FSM type" } };
+        if (CheckSpecArgs(spec, 2, 3, ranges, error))
+            return new NbitPredictor(a[0], a[1], a.size() > 2 ? a[2] : 1);
+    } else if (n == "global") {
+        static const SpecRange ranges[] = { { 0, 29, "address bits" }, { 1, 8, "history bits" } };
+        if (CheckSpecArgs(spec, 2, 2, ranges, error)) {
+            if (a[0] + a[1] <= 30)
+                return new GlobalHistoryPredictor(a[0], a[1]);
+            SpecError(spec, "takes at most 30 index bits", error);
+        }
+    } else if (n == "gconcat" || n == "gselect" || n == "gshare" || n == "gfolded") {
+        static const SpecRange ranges[] = {
+            { 1, 30, "index bits" }, { 1, 65536, "history length" }, { 1, 8, "counter bits" } };
+        GlobalHistoryHash hash = n == "gconcat" ? GHIST_CONCAT : n == "gselect" ? GHIST_GSELECT
+                               : n == "gshare" ? GHIST_GSHARE : GHIST_FOLDED;
+        if (CheckSpecArgs(spec, 3, 3, ranges, error))
+            return new GlobalHistoryPredictor(a[0], a[1], a[2], hash);
+    } else if (n == "local") {
+        static const SpecRange ranges[] = {
+            { 1, 20, "BHT index bits" }, { 1, 65536, "history length" },
+            { 1, 30, "PHT index bits" }, { 1, 8, "counter bits" } };
+        if (CheckSpecArgs(spec, 2, 4, ranges, error)) {
+            if (a.size() == 4)
+                return new LocalHistoryPredictor(a[0], a[1], a[2], a[3]);
+            if (a.size() == 2)
+                return new LocalHistoryPredictor(a[0], a[1]);
+            SpecError(spec, "takes 2 or 4 arguments", error);
+        }
+    } else if (n == "tournament") {
+        static const SpecRange ranges[] = { { 1, 30, "meta index bits" } };
+        if (CheckSpecArgs(spec, 3, 3, ranges, error)) {
+            BranchPredictor *pred0 = BuildBranchPredictor(spec.args[1], error);
+            BranchPredictor *pred1 = pred0 ? BuildBranchPredictor(spec.args[2], error) : NULL;
+            if (pred1)
+                return new TournamentHybridPredictor(a[0], pred0, pred1);
+            delete pred0;
+        }
+    } else if (n == "hybrid") {
+        static const SpecRange ranges[] = { { 1, 24, "table bits" } };
+        // The arbitration scheme is a name, so it passes as a "predictor"
+        if (CheckSpecArgs(spec, 4, 2 + HYBRID_MAX_COMPONENTS, ranges, error)) {
+            static const char *schemes[] = { "meta_pc", "meta_ghist", "priority", "adder" };
+            const string &s = spec.args[1].name;
+            std::vector<BranchPredictor *> components;
+            UINT32 scheme = 0;
+
+            while (scheme < 4 && s != schemes[scheme])
+                scheme++;
+            if (scheme == 4) {
+                error = "unknown hybrid arbitration " + s;
+                return NULL;
+            }
+            if (!spec.args[1].args.empty()) {
+                SpecError(spec, "takes a plain arbitration name", error);
+                return NULL;
+            }
+            for (UINT32 i = 2; i < spec.args.size(); i++) {
+                BranchPredictor *bp = BuildBranchPredictor(spec.args[i], error);
+                if (!bp) {
+                    for (UINT32 j = 0; j < components.size(); j++)
+                        delete components[j];
+                    return NULL;
+                }
+                components.push_back(bp);
+            }
+            return new HybridPredictor((HybridArbitration)scheme, a[0], components);
+        }
+    } else if (n == "loop") {
+        static const SpecRange ranges[] = {
+            { 1, 1 << 24, "entries" }, { 1, 64, "ways" }, { 1, 16, "tag bits" },
+            { 1, 16, "iteration bits" }, { 1, 255, "confidence" } };
+        if (CheckSpecArgs(spec, 6, 6, ranges, error)) {
+            INT64 sets = a[0] / a[1];
+            if (sets * a[1] != a[0] || (sets & (sets - 1)) != 0) {
+                SpecError(spec, "needs a power of two number of sets of ways entries", error);
+                return NULL;
+            }
+            BranchPredictor *base = BuildBranchPredictor(spec.args[5], error);
+            if (base)
+                return new LoopOverlayPredictor(a[0], a[1], a[2], a[3], a[4], base);
+        }
+    } else if (n == "tage") {
+        const SpecRange budget[] = {
+            { TAGEPredictor::MinStorageKbits(), 1 << 20, "storage Kbits" } };
+        static const SpecRange ranges[] = {
+            { 1, 32, "tables" }, { 1, 24, "table index bits" }, { 2, 16, "tag bits" },
+            { 1, 65536, "minimum history" }, { 1, 65536, "maximum history" },
+            { 1, 30, "bimodal index bits" } };
+        if (spec.args.size() == 1) {
+            if (CheckSpecArgs(spec, 1, 1, budget, error))
+                return new TAGEPredictor(a[0]);
+        } else if (CheckSpecArgs(spec, 6, 6, ranges, error)) {
+            if (a[4] >= a[3])
+                return new TAGEPredictor(a[0], a[1], a[2], a[3], a[4], a[5]);
+            SpecError(spec, "needs a maximum history of at least the minimum one", error);
+        }
+    } else if (n == "perceptron") {
+        static const SpecRange ranges[] = {
+            { 1, 24, "index bits" }, { 1, 4096, "history length" } };
+        if (CheckSpecArgs(spec, 2, 2, ranges, error))
+            return new PerceptronPredictor(a[0], a[1]);
+    } else if (n == "hashed_perceptron") {
+        static const SpecRange ranges[] = {
+            { 1, 32, "tables" }, { 1, 24, "index bits" }, { 2, 65536, "maximum history" } };
+        if (CheckSpecArgs(spec, 3, 3, ranges, error))
+            return new HashedPerceptronPredictor(a[0], a[1], a[2]);
+    } else {
+        error = "unknown predictor " + n;
+    }
+    return NULL;
+}
+
+/**
+ * Parses text and adds the predictors of every spec in it to the vectors.
+ * Returns false and describes the problem in error if anything is wrong;
+ * the vectors may then hold the predictors of the specs before it.
+ **/
+inline bool BuildPredictorsFromSpecs(const string &text,
+                                     std::vector<BranchPredictor *> &branch_predictors,
+                                     std::vector<BTBPredictor *> &btb_predictors,
+                                     std::vector<RASGroup *> &ras_vec,
+                                     std::vector<IndirectPredictor *> &indirect_predictors,
+                                     string &error)
+{
+    PredictorSpecParser parser(text);
+    std::vector<PredictorSpec> specs, expanded;
+    RASGroup *ras_group = NULL;
+    UINT64 budget_bits = 0;
+
+    if (!parser.parse(specs)) {
+        error = parser.getError();
+        return false;
+    }
+    for (UINT32 i = 0; i < specs.size(); i++) {
+        if (specs[i].name == "budget") {
+            if (!CheckSpecArgs(specs[i], 1, 1, error))
+                return false;
+            if (specs[i].args[0].lo != specs[i].args[0].hi || specs[i].args[0].lo <= 0) {
+                error = "budget takes a positive number of bits: " + specs[i].toString();
+                return false;
+            }
+            budget_bits = specs[i].args[0].lo;
+            continue;
+        }
+        if (!ExpandPredictorSpec(specs[i], expanded)) {
+            error = "too many configurations in " + specs[i].toString();
+            return false;
+        }
+    }
+
+    for (UINT32 i = 0; i < expanded.size(); i++) {
+        const PredictorSpec &spec = expanded[i];
+        const string &n = spec.name;
+        UINT32 first_bp = branch_predictors.size(), first_btb = btb_predictors.size();
+        UINT32 first_ibp = indirect_predictors.size();
+
+        if (n == "default_predictors") {
+            if (CheckSpecArgs(spec, 0, 0, error))
+                InitPredictors(branch_predictors);
+        } else if (n == "default_btbs") {
+            if (CheckSpecArgs(spec, 0, 0, error))
+                BTB(btb_predictors);
+        } else if (n == "default_ras") {
+            if (CheckSpecArgs(spec, 0, 0, error))
+                InitRas(ras_vec);
+        } else if (n == "default_indirect") {
+            if (CheckSpecArgs(spec, 0, 0, error))
+                InitIndirectPredictors(indirect_predictors);
+        } else if (n == "btb") {
+            static const SpecRange ranges[] = {
+                { 1, 1 << 24, "lines" }, { 1, BTB_MAX_ASSOC, "associativity" } };
+            BTBReplacement replacement = BTB_LRU;
+
+            if (!CheckSpecArgs(spec, 2, 3, ranges, error))
+                return false;
+            if (spec.args[0].lo % spec.args[1].lo != 0)
+                return SpecError(spec, "needs an associativity that divides the lines", error);
+            if (spec.args.size() > 2) {
+                const string &r = spec.args[2].name;
+                if (r == "plru")
+                    replacement = BTB_PLRU;
+                else if (r == "random")
+                    replacement = BTB_RANDOM;
+                else if (r != "lru")
+                    error = "unknown BTB replacement " + r;
+            }
+            if (error.empty())
+                btb_predictors.push_back(new BTBPredictor(spec.args[0].lo, spec.args[1].lo,
+                                                          replacement));
+        } else if (n == "ras") {
+            static const SpecRange ranges[] = { { 1, 1 << 20, "entries" } };
+            if (CheckSpecArgs(spec, 1, 1, ranges, error)
+                && (budget_bits == 0 || RAS::StorageBits(spec.args[0].lo) <= budget_bits)) {
+                if (!ras_group) {
+                    ras_group = new RASGroup();
+                    ras_vec.push_back(ras_group);
+                }
+                ras_group->addRAS(spec.args[0].lo);
+            }
+        } else if (n == "ibtb") {
+            static const SpecRange ranges[] = {
+                { 1, 24, "index bits" }, { 0, 64, "path history bits" } };
+            if (CheckSpecArgs(spec, 1, 2, ranges, error))
+                indirect_predictors.push_back(new IBTBPredictor(spec.args[0].lo,
+                                              spec.args.size() > 1 ? spec.args[1].lo : 0));
+        } else if (n == "pentium_m_ibtb") {
+            if (CheckSpecArgs(spec, 0, 0, error))
+                indirect_predictors.push_back(new PentiumMIndirectPredictor());
+        } else if (n == "ittage") {
+            static const SpecRange ranges[] = {
+                { 1, 32, "tables" }, { 1, 24, "table index bits" }, { 2, 16, "tag bits" },
+                { 1, 65536, "minimum history" }, { 1, 65536, "maximum history" },
+                { 1, 24, "base index bits" } };
+            if (!CheckSpecArgs(spec, 6, 6, ranges, error))
+                return false;
+            if (spec.args[4].lo < spec.args[3].lo)
+                return SpecError(spec, "needs a maximum history of at least the minimum one", error);
+            indirect_predictors.push_back(new ITTAGEPredictor(spec.args[0].lo, spec.args[1].lo,
+                                          spec.args[2].lo, spec.args[3].lo,
+                                          spec.args[4].lo, spec.args[5].lo));
+        } else {
+            BranchPredictor *bp = BuildBranchPredictor(spec, error);
+            if (bp)
+                branch_predictors.push_back(bp);
+        }
+
+        if (!error.empty())
+            return false;
+
+        // Dropped as soon as they are built, so that a large sweep does
+        // not hold the tables of every configuration at once
+        if (budget_bits > 0) {
+            DropOverBudget(branch_predictors, first_bp, budget_bits);
+            DropOverBudget(btb_predictors, first_btb, budget_bits);
+            DropOverBudget(indirect_predictors, first_ibp, budget_bits);
+        }
+    }
+    return true;
+}
+
+//> Reads a whole spec file into text
+inline bool ReadPredictorSpecFile(const string &path, string &text)
+{
+    std::ifstream in(path.c_str());
+    std::ostringstream stream;
+
+    if (!in)
+        return false;
+    stream << in.rdbuf();
+    text += stream.str();
+    text += "\n";
+    return true;
+}
+
+#endif
@@ -3,47 +3,350 @@
 
 #include <vector>
 #include <sstream>
+#include <cstdlib>
 
+#include "counter_table.h"
+#include "history_register.h"
+#include "state_archive.h"
+
+/**
+ * Return address stack of a fixed depth, kept as a circular buffer: a push
+ * on a full stack overwrites the oldest entry, so push and pop are O(1).
+ *
+ * A return is incorrect either because the stack was empty (underflow) or
+ * because the address on top was not its target (mismatch). Overflows count
+ * the entries lost to pushes on a full stack.
+ *
+ * When the RAS belongs to a RASGroup the addresses are kept by the group and
+ * only the number of valid entries and the counters are kept here.
+ **/
 class RAS
 {
 public:
-    RAS(UINT32 num_entries) 
-      : max_entries(num_entries), correct(0), incorrect(0) {};
+    RAS(UINT32 num_entries)
+      : max_entries(num_entries), addr_vec(num_entries), top(0), count(0),
+        correct(0), incorrect(0), overflows(0), underflows(0), mismatches(0) {};
     ~RAS() {};
 
     void push_addr(ADDRINT addr) {
-        addr_vec.push_back(addr);
-        if (addr_vec.size() > max_entries)
-            addr_vec.erase(addr_vec.begin());
+        addr_vec[top] = addr;
+        top = (top + 1 == max_entries) ? 0 : top + 1;
+        pushed();
     }
 
     void pop_addr(ADDRINT target) {
-        if (addr_vec.empty()) {
-            incorrect++;
+        if (count == 0) {
+            popped(false);
             return;
         }
 
-        ADDRINT ras_ip = *(addr_vec.end() - 1);
-        addr_vec.pop_back();
-
-        if (ras_ip == target)
-            correct++;
-        else
-            incorrect++;
+        top = (top == 0) ? max_entries - 1 : top - 1;
+        popped(addr_vec[top] == target);
     }
 
-    string getNameAndStats() { 
+    string getNameAndStats() {
         std::ostringstream stream;
         stream << "RAS (" << max_entries << " entries): " << correct <<
                                                       " " << incorrect;
-        return stream.str(); 
+        return stream.str();
+    };
+
+    UINT32 getNumEntries() const { return max_entries; }
+
+    //> The addresses, the top-of-stack pointer and the count of valid
+    //  entries, also for a member of a RASGroup
+    UINT64 getStorageBits() const { return StorageBits(max_entries); }
+
+    static UINT64 StorageBits(UINT32 num_entries) {
+        return (UINT64)num_entries * 8 * sizeof(ADDRINT) + CeilLog2(num_entries)
+               + CeilLog2(num_entries + 1);
+    }
+    UINT64 getNumCorrect() const { return correct; }
+    UINT64 getNumIncorrect() const { return incorrect; }
+    UINT64 getNumOverflows() const { return overflows; }
+    UINT64 getNumUnderflows() const { return underflows; }
+    UINT64 getNumMismatches() const { return mismatches; }
+
+    //> Adds the counters of another stack of the same depth
+    void mergeCounters(const RAS &other) {
+        correct += other.correct;
+        incorrect += other.incorrect;
+        overflows += other.overflows;
+        underflows += other.underflows;
+        mismatches += other.mismatches;
+    }
+
+    //> Entries of a stack that is not in a RASGroup, see predictor_snapshot.h
+    void serializeState(StateArchive &ar) {
+        ar.io(addr_vec);
+        ar.io(top);
+        ar.io(count);
+    }
+
+    void serializeCounters(StateArchive &ar) {
+        ar.io(correct);
+        ar.io(incorrect);
+        ar.io(overflows);
+        ar.io(underflows);
+        ar.io(mismatches);
+    }
+
+private:
+    friend class RASGroup;
+
+    //> Bookkeeping of a push, the address is already stored
+    void pushed() {
+        if (count == max_entries)
+            overflows++;
+        else
+            count++;
+    }
+
+    //> Bookkeeping of a pop, hit tells whether the top entry was the target
+    void popped(bool hit) {
+        if (count == 0) {
+            underflows++;
+            incorrect++;
+            return;
+        }
+
+        count--;
+        if (hit) {
+            correct++;
+        } else {
+            mismatches++;
+            incorrect++;
+        }
+    }
+
+    UINT32 max_entries;
+    std::vector<ADDRINT> addr_vec;
+    UINT32 top;     // slot the next push goes to
+    UINT32 count;   // valid entries
+
+    UINT64 correct, incorrect;
+    UINT64 overflows, underflows, mismatches;
+};
+
+/**
+ * How the RAS of a RASGroup is repaired after a mispredicted branch:
+ *   RAS_NO_WRONG_PATH  - no wrong path is modelled (the default)
+ *   RAS_REPAIR_NONE    - the wrong path corrupts the stack and nothing is repaired
+ *   RAS_REPAIR_TOS     - the top-of-stack pointer is checkpointed and restored
+ *   RAS_REPAIR_TOS_TOP - the pointer and the top entry are checkpointed and restored
+ **/
+enum RASRepair {
+    RAS_NO_WRONG_PATH,
+    RAS_REPAIR_NONE,
+    RAS_REPAIR_TOS,
+    RAS_REPAIR_TOS_TOP
+};
+
+/**
+ * Parses "off", "none", "tos" or "tos+top", optionally followed by
+ * ":rets,calls" to set the shape of the modelled wrong path.
+ **/
+inline bool ParseRASRepair(const string &spec, RASRepair &repair,
+                           UINT32 &wrong_path_rets, UINT32 &wrong_path_calls)
+{
+    string mode = spec.substr(0, spec.find(':'));
+
+    if (mode == "off")
+        repair = RAS_NO_WRONG_PATH;
+    else if (mode == "none")
+        repair = RAS_REPAIR_NONE;
+    else if (mode == "tos")
+        repair = RAS_REPAIR_TOS;
+    else if (mode == "tos+top")
+        repair = RAS_REPAIR_TOS_TOP;
+    else
+        return false;
+
+    if (mode.size() < spec.size()) {
+        const char *shape = spec.c_str() + mode.size() + 1;
+        char *end;
+        wrong_path_rets = strtoul(shape, &end, 10);
+        if (*end != ',')
+            return false;
+        wrong_path_calls = strtoul(end + 1, &end, 10);
+        if (*end != '\0')
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Several RAS of different depths fed by one call/return stream.
+ *
+ * A stack of depth N that drops its oldest entry on overflow always holds
+ * the newest count(N) entries of the deepest stack, since both see the same
+ * pushes and pops. The group therefore keeps the addresses once, in a ring
+ * as deep as the deepest member, and each member only tracks its count: a
+ * return compares its target with the shared top entry once and every
+ * member with a non-empty stack scores that same outcome.
+ *
+ * Pin only shows the correct path, so wrong-path execution is approximated
+ * when enabled with setRepair(): the group predicts every conditional branch
+ * with a gshare, and on a misprediction it assumes the wrong path executes
+ * wrong_path_rets returns and then wrong_path_calls calls before the branch
+ * resolves. Depending on the repair mode the top-of-stack pointer (and the
+ * top entry) saved at the branch is then restored. The wrong path is
+ * applied to the shared ring, so a member that holds fewer entries than the
+ * wrong path pops does not see corruption below its own bottom.
+ **/
+class RASGroup
+{
+public:
+    RASGroup()
+      : max_entries(0), top(0), count(0), repair(RAS_NO_WRONG_PATH),
+        wrong_path_rets(1), wrong_path_calls(1),
+        dir_history(RAS_DIR_INDEX_BITS), dir_table(RAS_DIR_INDEX_BITS) {
+        // Weakly taken, as GlobalHistoryPredictor
+        for (unsigned i = 0; i < dir_table.size(); i++)
+            dir_table.set(i, 2);
     };
+    ~RASGroup() {
+        for (std::vector<RAS *>::iterator it = members.begin(); it != members.end(); ++it)
+            delete *it;
+    };
+
+    //> Adds a stack of num_entries, must be called before any push
+    void addRAS(UINT32 num_entries) {
+        members.push_back(new RAS(num_entries));
+        if (num_entries > max_entries) {
+            max_entries = num_entries;
+            addr_vec.resize(max_entries);
+        }
+    }
+
+    void setRepair(RASRepair repair_, UINT32 rets = 1, UINT32 calls = 1) {
+        repair = repair_;
+        wrong_path_rets = rets;
+        wrong_path_calls = calls;
+    }
+
+    const std::vector<RAS *> &getRAS() const { return members; }
+
+    //> Adds the counters of a group with the same depths
+    void mergeCounters(const RASGroup &other) {
+        for (UINT32 i = 0; i < members.size(); i++)
+            members[i]->mergeCounters(*other.members[i]);
+    }
+
+    //> The shared entries, the depth of every member and the wrong path model
+    void serializeState(StateArchive &ar) {
+        std::vector<UINT32> counts(members.size());
+
+        for (UINT32 i = 0; i < members.size(); i++)
+            counts[i] = members[i]->count;
+        ar.io(addr_vec);
+        ar.io(top);
+        ar.io(count);
+        ar.io(counts);
+        dir_history.serialize(ar);
+        dir_table.serialize(ar);
+        if (ar.isLoading() && ar.good())
+            for (UINT32 i = 0; i < members.size(); i++)
+                members[i]->count = counts[i];
+    }
+
+    void serializeCounters(StateArchive &ar) {
+        for (UINT32 i = 0; i < members.size(); i++)
+            members[i]->serializeCounters(ar);
+    }
+
+    void push_addr(ADDRINT addr) {
+        push(addr);
+        for (std::vector<RAS *>::iterator it = members.begin(); it != members.end(); ++it)
+            (*it)->pushed();
+    }
+
+    void pop_addr(ADDRINT target) {
+        bool hit = count > 0 && pop() == target;
+        for (std::vector<RAS *>::iterator it = members.begin(); it != members.end(); ++it)
+            (*it)->popped(hit);
+    }
+
+    //> Conditional branches drive the wrong path model, if it is enabled
+    void cond_branch(ADDRINT ip, BOOL taken) {
+        if (repair == RAS_NO_WRONG_PATH || members.empty())
+            return;
+
+        unsigned index = (ip ^ dir_history.value(RAS_DIR_INDEX_BITS)) & (dir_table.size() - 1);
+        bool mispredicted = dir_table.predict(index) != (bool)taken;
+        dir_table.update(index, taken);
+        dir_history.push(taken);
+
+        if (mispredicted)
+            wrongPath();
+    }
 
 private:
+    static const unsigned RAS_DIR_INDEX_BITS = 14;
+
+    void push(ADDRINT addr) {
+        addr_vec[top] = addr;
+        top = (top + 1 == max_entries) ? 0 : top + 1;
+        if (count < max_entries)
+            count++;
+    }
+
+    ADDRINT pop() {
+        top = (top == 0) ? max_entries - 1 : top - 1;
+        count--;
+        return addr_vec[top];
+    }
+
+    //> Calls and returns of the wrong path, they change the stacks but are
+    //  not scored
+    void wrongPath() {
+        UINT32 saved_top = top, saved_count = count;
+        UINT32 top_slot = (top == 0) ? max_entries - 1 : top - 1;
+        ADDRINT saved_entry = addr_vec[top_slot];
+
+        saved_counts.resize(members.size());
+        for (UINT32 i = 0; i < members.size(); i++)
+            saved_counts[i] = members[i]->count;
+
+        for (UINT32 i = 0; i < wrong_path_rets && count > 0; i++)
+            pop();
+        for (UINT32 i = 0; i < wrong_path_rets; i++)
+            for (std::vector<RAS *>::iterator it = members.begin(); it != members.end(); ++it)
+                if ((*it)->count > 0)
+                    (*it)->count--;
+        for (UINT32 i = 0; i < wrong_path_calls; i++) {
+            // Nothing ever returns to a wrong-path call site
+            push(0);
+            for (std::vector<RAS *>::iterator it = members.begin(); it != members.end(); ++it)
+                if ((*it)->count < (*it)->max_entries)
+                    (*it)->count++;
+        }
+
+        if (repair == RAS_REPAIR_NONE)
+            return;
+
+        top = saved_top;
+        count = saved_count;
+        for (UINT32 i = 0; i < members.size(); i++)
+            members[i]->count = saved_counts[i];
+        if (repair == RAS_REPAIR_TOS_TOP)
+            addr_vec[top_slot] = saved_entry;
+    }
+
+    std::vector<RAS *> members;
+
+    // Addresses shared by all members
     UINT32 max_entries;
     std::vector<ADDRINT> addr_vec;
+    UINT32 top, count;
+
+    RASRepair repair;
+    UINT32 wrong_path_rets, wrong_path_calls;
+    std::vector<UINT32> saved_counts;
 
-    unsigned long long correct, incorrect;
+    // gshare that decides which branches are mispredicted
+    HistoryRegister dir_history;
+    PackedCounterTable<2> dir_table;
 };
 
 #endif
@@ -0,0 +1,211 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+/**
+ * Sampled simulation, in the style of SMARTS and SimPoint.
+ *
+ * The run is split in windows of three phases:
+ *   fast-forward - instructions are only counted, nothing is simulated
+ *   warm-up      - the predictors are trained but the window is not measured
+ *   detail       - the predictors are trained and measured
+ * Windows either repeat with a fixed period or start at given instruction
+ * offsets (the simulation points), each with a weight.
+ *
+ * Every phase switch starts a new epoch. The epoch numbers run through the
+ * three phases in order, also for phases of length 0, so the phase and the
+ * window of an epoch follow from its number alone.
+ **/
+
+#include <ostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include "interval_stats.h"
+
+enum SamplePhase {
+    SAMPLE_FFWD = 0,
+    SAMPLE_WARMUP,
+    SAMPLE_DETAIL,
+    SAMPLE_NUM_PHASES
+};
+
+static inline SamplePhase PhaseOfEpoch(UINT32 epoch)
+{
+    return (SamplePhase)(epoch % SAMPLE_NUM_PHASES);
+}
+
+static inline UINT32 WindowOfEpoch(UINT32 epoch)
+{
+    return epoch / SAMPLE_NUM_PHASES;
+}
+
+class SampleSchedule
+{
+public:
+    //> Periodic windows of ffwd + warmup + detail instructions
+    SampleSchedule(UINT64 ffwd, UINT64 warmup, UINT64 detail)
+      : ffwd(ffwd), warmup(warmup), detail(detail), epoch(0) {
+        next_switch = detailStart(0) - warmup;
+    };
+
+    //> Windows at the offsets of a simulation point file, see readPoints()
+    SampleSchedule(UINT64 warmup, UINT64 detail)
+      : ffwd(0), warmup(warmup), detail(detail), epoch(0), next_switch(~0ULL) {};
+
+    /**
+     * Reads "offset [weight]" lines, the instruction offsets of the detail
+     * windows in increasing order; the weight defaults to 1 and '#' starts
+     * a comment.
+     **/
+    bool readPoints(const string &path, string &error) {
+        std::ifstream in(path.c_str());
+        string line;
+
+        if (!in) {
+            error = "cannot read " + path;
+            return false;
+        }
+        while (std::getline(in, line)) {
+            std::istringstream fields(line.substr(0, line.find('#')));
+            UINT64 offset;
+            double weight = 1.0;
+            if (!(fields >> offset))
+                continue;
+            fields >> weight;
+            if (!points.empty() && offset < points.back() + detail) {
+                error = "simulation points must be increasing and at least one window apart";
+                return false;
+            }
+            points.push_back(offset);
+            weights.push_back(weight);
+        }
+        if (points.empty()) {
+            error = "no simulation points in " + path;
+            return false;
+        }
+
+        next_switch = points[0] > warmup ? points[0] - warmup : 0;
+        return true;
+    }
+
+    bool isPeriodic() const { return points.empty(); }
+
+    UINT32 getEpoch() const { return epoch; }
+    SamplePhase getPhase() const { return PhaseOfEpoch(epoch); }
+
+    //> Instruction count of the next phase switch
+    UINT64 getNextSwitch() const { return next_switch; }
+
+    double getWeight(UINT32 window) const {
+        return isPeriodic() ? 1.0 : weights[window];
+    }
+
+    //> Moves to the next epoch, icount is the instruction count of the switch
+    void advance(UINT64 icount) {
+        epoch++;
+        UINT32 window = WindowOfEpoch(epoch);
+
+        switch (getPhase()) {
+        case SAMPLE_WARMUP:
+            next_switch = detailStart(window);
+            break;
+        case SAMPLE_DETAIL:
+            next_switch = std::max(icount, detailStart(window)) + detail;
+            break;
+        default:
+            if (!isPeriodic() && window >= points.size())
+                next_switch = ~0ULL;   // no more windows
+            else
+                next_switch = detailStart(window) > warmup ? detailStart(window) - warmup : 0;
+            break;
+        }
+    }
+
+private:
+    UINT64 detailStart(UINT32 window) const {
+        if (isPeriodic())
+            return window * (ffwd + warmup + detail) + ffwd + warmup;
+        return points[window];
+    }
+
+    UINT64 ffwd, warmup, detail;
+    std::vector<UINT64> points;
+    std::vector<double> weights;
+
+    UINT32 epoch;
+    UINT64 next_switch;
+};
+
+/**
+ * MPKI of every predictor over the detail windows. Each window is one
+ * sample; the estimate is the weighted mean of the window MPKIs and, for
+ * periodic windows, the 95% confidence interval assumes that the windows
+ * are a random sample of the run, as SMARTS does.
+ **/
+class SampleStats
+{
+public:
+    SampleStats() : num_windows(0), detail_instructions(0) {};
+
+    void start(std::vector<BranchPredictor *> &branch_predictors,
+               std::vector<BTBPredictor *> &btb_predictors,
+               std::vector<RASGroup *> &ras_vec,
+               std::vector<IndirectPredictor *> &indirect_predictors) {
+        counters.add(branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+        start_incorrect.assign(counters.size(), 0);
+        sum_w.assign(counters.size(), 0.0);
+        sum_wx.assign(counters.size(), 0.0);
+        sum_wxx.assign(counters.size(), 0.0);
+    }
+
+    //> The counters of every predictor when a detail window starts
+    void beginWindow() {
+        UINT64 correct;
+        for (UINT32 i = 0; i < counters.size(); i++)
+            counters.read(i, correct, start_incorrect[i]);
+    }
+
+    //> A detail window of this many instructions is over
+    void endWindow(UINT64 instructions, double weight) {
+        if (instructions == 0)
+            return;
+
+        for (UINT32 i = 0; i < counters.size(); i++) {
+            UINT64 correct, incorrect;
+            counters.read(i, correct, incorrect);
+            double mpki = (incorrect - start_incorrect[i]) * 1000.0 / instructions;
+            sum_w[i] += weight;
+            sum_wx[i] += weight * mpki;
+            sum_wxx[i] += weight * mpki * mpki;
+        }
+        num_windows++;
+        detail_instructions += instructions;
+    }
+
+    void print(std::ostream &out, bool with_confidence) {
+        out << "Sampled windows: " << num_windows << "\n";
+        out << "Sampled instructions: " << detail_instructions << "\n";
+        out << "Sampled MPKI: (Name - MPKI - 95% Confidence)\n";
+        for (UINT32 i = 0; i < counters.size(); i++) {
+            double mean = sum_w[i] > 0 ? sum_wx[i] / sum_w[i] : 0.0;
+            out << "  " << counters.getName(i) << ": " << mean;
+            if (with_confidence && num_windows > 1) {
+                double var = sum_wxx[i] / sum_w[i] - mean * mean;
+                var = var > 0 ? var * num_windows / (num_windows - 1) : 0.0;
+                out << " +- " << 1.96 * sqrt(var / num_windows);
+            }
+            out << "\n";
+        }
+    }
+
+private:
+    PredictorCounters counters;
+    std::vector<UINT64> start_incorrect;
+    std::vector<double> sum_w, sum_wx, sum_wxx;
+    UINT32 num_windows;
+    UINT64 detail_instructions;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef STATE_ARCHIVE_H
+#define STATE_ARCHIVE_H
+
+/**
+ * Binary image of the state of a predictor, see predictor_snapshot.h.
+ *
+ * The same serialize function of a class both saves and loads it: it calls
+ * io() on every field, which appends the field to the image when saving and
+ * overwrites it from the image when loading. Vectors are stored with their
+ * size and a loaded vector must already have that size, so an image only
+ * loads into a predictor of the same geometry; anything else marks the
+ * archive as failed and leaves the rest of the fields alone.
+ **/
+
+#include <vector>
+#include <cstring>
+
+class StateArchive
+{
+public:
+    //> Saving, getData() has the image afterwards
+    StateArchive() : loading(false), pos(0), failed(false) {};
+
+    //> Loading from image
+    StateArchive(const std::vector<UINT8> &image)
+      : loading(true), data(image), pos(0), failed(false) {};
+
+    bool isLoading() const { return loading; }
+
+    //> False once a load ran out of data or hit a size mismatch
+    bool good() const { return !failed; }
+
+    //> True once the whole image was loaded
+    bool done() const { return !failed && pos == data.size(); }
+
+    const std::vector<UINT8> &getData() const { return data; }
+
+    //> Any plain value or struct without pointers
+    template <class T>
+    void io(T &value) { bytes(&value, sizeof(T)); }
+
+    template <class T, size_t N>
+    void io(T (&values)[N]) { bytes(values, sizeof(values)); }
+
+    template <class T>
+    void io(std::vector<T> &values) {
+        if (!checkSize(values.size()) || values.empty())
+            return;
+        bytes(&values[0], values.size() * sizeof(T));
+    }
+
+    //> One byte per flag, vector<bool> has no contiguous storage
+    void io(std::vector<bool> &values) {
+        if (!checkSize(values.size()))
+            return;
+        for (UINT32 i = 0; i < values.size(); i++) {
+            UINT8 flag = values[i];
+            io(flag);
+            values[i] = flag != 0;
+        }
+    }
+
+private:
+    void bytes(void *p, size_t n) {
+        if (failed)
+            return;
+        if (!loading) {
+            data.insert(data.end(), (const UINT8 *)p, (const UINT8 *)p + n);
+        } else if (pos + n > data.size()) {
+            failed = true;
+        } else {
+            memcpy(p, &data[pos], n);
+            pos += n;
+        }
+    }
+
+    bool checkSize(UINT32 size) {
+        UINT32 stored = size;
+        io(stored);
+        if (loading && stored != size)
+            failed = true;
+        return !failed;
+    }
+
+    bool loading;
+    std::vector<UINT8> data;
+    size_t pos;
+    bool failed;
+};
+
+#endif
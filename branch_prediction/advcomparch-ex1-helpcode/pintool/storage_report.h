@@ -0,0 +1,73 @@
+#ifndef STORAGE_REPORT_H
+#define STORAGE_REPORT_H
+
+/**
+ * Storage against accuracy: the bits of every predictor (getStorageBits())
+ * next to its MPKI, smallest first within each kind of predictor. A
+ * predictor is on the Pareto frontier of its kind ('*') when no other
+ * predictor of that kind needs at most as many bits and mispredicts less;
+ * the others ('-') are beaten by something as small. Together with a
+ * budget(bits) spec (see predictor_spec.h) one run of a sweep gives the
+ * best configurations under the budget for the simulated benchmark.
+ **/
+
+#include <ostream>
+#include <vector>
+#include <algorithm>
+
+#include "interval_stats.h"
+
+//> Orders predictors by kind, storage and then mispredictions
+struct StorageOrder {
+    const std::vector<PredictorKind> &kinds;
+    const std::vector<UINT64> &bits, &incorrect;
+
+    bool operator()(UINT32 a, UINT32 b) const {
+        if (kinds[a] != kinds[b])
+            return kinds[a] < kinds[b];
+        if (bits[a] != bits[b])
+            return bits[a] < bits[b];
+        return incorrect[a] < incorrect[b];
+    }
+};
+
+inline VOID PrintStorage(std::ostream &out, UINT64 total_instructions,
+                         std::vector<BranchPredictor *> &branch_predictors,
+                         std::vector<BTBPredictor *> &btb_predictors,
+                         std::vector<RASGroup *> &ras_vec,
+                         std::vector<IndirectPredictor *> &indirect_predictors)
+{
+    PredictorCounters counters;
+    std::vector<PredictorKind> kinds;
+    std::vector<UINT64> bits, incorrect;
+    std::vector<UINT32> order;
+
+    counters.add(branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+    for (UINT32 i = 0; i < counters.size(); i++) {
+        UINT64 correct, wrong;
+        counters.read(i, correct, wrong);
+        kinds.push_back(counters.getKind(i));
+        bits.push_back(counters.getStorageBits(i));
+        incorrect.push_back(wrong);
+        order.push_back(i);
+    }
+    StorageOrder by_storage = { kinds, bits, incorrect };
+    std::stable_sort(order.begin(), order.end(), by_storage);
+
+    out << "Storage: (Name - Bits - MPKI - Pareto)\n";
+    UINT64 best = 0; // fewest mispredictions of the kind so far
+    for (UINT32 n = 0; n < order.size(); n++) {
+        UINT32 i = order[n];
+        // Everything as small of the kind comes before, so the predictor is
+        // on the frontier if it beats all of them
+        bool pareto = n == 0 || kinds[order[n - 1]] != kinds[i] || incorrect[i] < best;
+        if (pareto)
+            best = incorrect[i];
+
+        out << "  " << counters.getName(i) << ": " << bits[i] << " "
+            << (total_instructions ? incorrect[i] * 1000.0 / total_instructions : 0.0) << " "
+            << (pareto ? "*" : "-") << "\n";
+    }
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef THREAD_DATA_H
+#define THREAD_DATA_H
+
+/**
+ * Per-thread data of a pintool, created when a thread starts and kept until
+ * Fini() so that it can be merged there.
+ *
+ * The data of every thread is reachable from a Pin TLS slot, for callbacks
+ * that get a THREADID, and from a tool register, for analysis routines
+ * (IARG_REG_VALUE with getReg() is much cheaper than a TLS lookup). Each
+ * instance is padded by a cache line on both sides, so the counters of two
+ * threads never share a line.
+ **/
+
+#include <vector>
+
+#define CACHE_LINE_SIZE 64
+
+template <class T>
+class ThreadDataRegistry
+{
+public:
+    ThreadDataRegistry() : key(-1), reg(REG_INVALID()) {};
+
+    //> Call once from main(), before PIN_StartProgram()
+    bool init() {
+        key = PIN_CreateThreadDataKey(NULL);
+        reg = PIN_ClaimToolRegister();
+        PIN_InitLock(&lock);
+        return key != -1 && REG_valid(reg);
+    }
+
+    //> Call from the thread start callback, ctxt is the one it was given
+    T *add(THREADID tid, CONTEXT *ctxt) {
+        Padded *padded = new Padded();
+        T *data = &padded->data;
+
+        PIN_SetThreadData(key, data, tid);
+        PIN_SetContextReg(ctxt, reg, (ADDRINT)data);
+        PIN_GetLock(&lock, tid + 1);
+        threads.push_back(data);
+        PIN_ReleaseLock(&lock);
+        return data;
+    }
+
+    T *get(THREADID tid) { return (T *)PIN_GetThreadData(key, tid); }
+    REG getReg() const { return reg; }
+
+    //> Sum of one counter over all the threads, safe while threads start
+    UINT64 sum(UINT64 T::*counter) {
+        UINT64 total = 0;
+
+        PIN_GetLock(&lock, PIN_ThreadId() + 1);
+        for (UINT32 i = 0; i < threads.size(); i++)
+            total += threads[i]->*counter;
+        PIN_ReleaseLock(&lock);
+        return total;
+    }
+
+    //> The data of every thread that ever started, in order of creation
+    UINT32 size() const { return threads.size(); }
+    T *operator[](UINT32 i) const { return threads[i]; }
+
+private:
+    struct Padded {
+        UINT8 before[CACHE_LINE_SIZE];
+        T data;
+        UINT8 after[CACHE_LINE_SIZE];
+    };
+
+    TLS_KEY key;
+    REG reg;
+    PIN_LOCK lock;
+    std::vector<T *> threads;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef TIMING_MODEL_H
+#define TIMING_MODEL_H
+
+/**
+ * First order timing model of the front end: every instruction takes
+ * base_cpi cycles and every miss of a predictor adds its penalty on top,
+ *   direction - mispredicted conditional branch, the pipeline is flushed
+ *   BTB       - branch without the right target in the BTB, fetch is redirected
+ *   RAS       - return to the wrong address
+ *   indirect  - indirect jump or call to the wrong target
+ * Misses are assumed not to overlap, so the cycles lost to each add up.
+ *
+ * The front end of the run is made of the first predictor of every kind. A
+ * row of the report is that front end with one predictor swapped in, so the
+ * predictors of a kind can be ranked against each other by their cycles. A
+ * kind without any predictor is taken as perfect.
+ **/
+
+#include <ostream>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+#include "interval_stats.h"
+
+class TimingModel
+{
+public:
+    TimingModel() : base_cpi(1.0) {
+        penalty[PREDICTOR_DIRECTION] = 14;
+        penalty[PREDICTOR_BTB] = 2;
+        penalty[PREDICTOR_RAS] = 14;
+        penalty[PREDICTOR_INDIRECT] = 14;
+    };
+
+    /**
+     * Parses "cpi,direction,btb,ras[,indirect]": the base CPI and the
+     * penalties in cycles. The indirect penalty defaults to the direction one.
+     **/
+    bool parse(const string &spec) {
+        int n = sscanf(spec.c_str(), "%lf,%lf,%lf,%lf,%lf", &base_cpi,
+                       &penalty[PREDICTOR_DIRECTION], &penalty[PREDICTOR_BTB],
+                       &penalty[PREDICTOR_RAS], &penalty[PREDICTOR_INDIRECT]);
+        if (n == 4)
+            penalty[PREDICTOR_INDIRECT] = penalty[PREDICTOR_DIRECTION];
+        return (n == 4 || n == 5) && base_cpi > 0;
+    }
+
+    void print(std::ostream &out, UINT64 total_instructions,
+               std::vector<BranchPredictor *> &branch_predictors,
+               std::vector<BTBPredictor *> &btb_predictors,
+               std::vector<RASGroup *> &ras_vec,
+               std::vector<IndirectPredictor *> &indirect_predictors) {
+        PredictorCounters counters;
+        double reference[PREDICTOR_NUM_KINDS] = { 0 };
+        bool has_reference[PREDICTOR_NUM_KINDS] = { false };
+        double base_cycles = base_cpi * total_instructions;
+
+        counters.add(branch_predictors, btb_predictors, ras_vec, indirect_predictors);
+        for (UINT32 i = 0; i < counters.size(); i++) {
+            PredictorKind kind = counters.getKind(i);
+            if (!has_reference[kind]) {
+                reference[kind] = lost(counters, i);
+                has_reference[kind] = true;
+            }
+        }
+
+        out << "Timing Model: (Base CPI - Direction - BTB - RAS - Indirect penalties)\n";
+        out << "  " << base_cpi;
+        for (int k = 0; k < PREDICTOR_NUM_KINDS; k++)
+            out << " " << penalty[k];
+        out << "\n";
+        out << "\n";
+
+        out << "Front-end Timing: (Name - Cycles - IPC - Lost Direction - Lost BTB - Lost RAS - Lost Indirect)\n";
+        for (UINT32 i = 0; i < counters.size(); i++) {
+            double cycles_lost[PREDICTOR_NUM_KINDS];
+            double cycles = base_cycles;
+            for (int k = 0; k < PREDICTOR_NUM_KINDS; k++)
+                cycles_lost[k] = reference[k];
+            cycles_lost[counters.getKind(i)] = lost(counters, i);
+            for (int k = 0; k < PREDICTOR_NUM_KINDS; k++)
+                cycles += cycles_lost[k];
+
+            out << "  " << counters.getName(i) << ": " << (UINT64)floor(cycles + 0.5) << " "
+                << (cycles > 0 ? total_instructions / cycles : 0.0);
+            for (int k = 0; k < PREDICTOR_NUM_KINDS; k++)
+                out << " " << (UINT64)floor(cycles_lost[k] + 0.5);
+            out << "\n";
+        }
+    }
+
+private:
+    double lost(const PredictorCounters &counters, UINT32 i) const {
+        UINT64 correct, incorrect;
+        counters.read(i, correct, incorrect);
+        return incorrect * penalty[counters.getKind(i)];
+    }
+
+    double base_cpi;
+    double penalty[PREDICTOR_NUM_KINDS];
+};
+
+#endif
@@ -11,21 +11,31 @@ predictors_to_plot = [ "  Nbit-16K-" ]
 
 x_Axis = []
 mpki_Axis = []
+## Filled only when the output has the "Front-end Timing" section (-timing)
+ipc = {}
+cycles = {}
 
 fp = open(sys.argv[1])
+section = ""
 line = fp.readline()
 while line:
 	tokens = line.split()
 	if line.startswith("Total Instructions:"):
 		total_ins = int(tokens[2])
+	elif not line.startswith(" "):
+		section = line
 	else:
 		for pred_prefix in predictors_to_plot:
 			if line.startswith(pred_prefix):
 				predictor_string = tokens[0].split(':')[0]
-				correct_predictions = int(tokens[1])
-				incorrect_predictions = int(tokens[2])
-				x_Axis.append(predictor_string)
-				mpki_Axis.append(incorrect_predictions / (total_ins / 1000.0))
+				if section.startswith("Branch Predictors:"):
+					correct_predictions = int(tokens[1])
+					incorrect_predictions = int(tokens[2])
+					x_Axis.append(predictor_string)
+					mpki_Axis.append(incorrect_predictions / (total_ins / 1000.0))
+				elif section.startswith("Front-end Timing:"):
+					cycles[predictor_string] = int(tokens[1])
+					ipc[predictor_string] = float(tokens[2])
 
 	line = fp.readline()
 
@@ -40,5 +50,22 @@ ax1.set_ylim(min(mpki_Axis) - 0.05, max(mpki_Axis) + 0.05)
 ax1.set_ylabel("$MPKI$")
 line1 = ax1.plot(mpki_Axis, label="mpki", color="red",marker='x')
 
-plt.title("MPKI")
+if ipc:
+	ipc_Axis = [ ipc[p] for p in x_Axis ]
+	ax2 = ax1.twinx()
+	ax2.set_ylim(min(ipc_Axis) - 0.05, max(ipc_Axis) + 0.05)
+	ax2.set_ylabel("$IPC$")
+	line2 = ax2.plot(ipc_Axis, label="ipc", color="green",marker='o')
+	lns = line1 + line2
+	ax1.legend(lns, [l.get_label() for l in lns], loc=0)
+	plt.title("MPKI vs IPC")
+
+	## Cycles saved against the worst of the plotted predictors
+	worst = max(cycles[p] for p in x_Axis)
+	print("Predictor: cycles saved, IPC")
+	for p in sorted(x_Axis, key=lambda p: cycles[p]):
+		print("  %s: %d %.4f" % (p, worst - cycles[p], ipc[p]))
+else:
+	plt.title("MPKI")
+
 plt.savefig(input("Please provide a filename for the produced file (e.g. output.png): "),bbox_inches="tight")
@@ -87,6 +87,12 @@ VOID count_instruction()
     total_cycles++;
 }
 
+VOID PIN_FAST_ANALYSIS_CALL count_bbl_instructions(UINT32 num_ins)
+{
+    total_instructions += num_ins;
+    total_cycles += num_ins;
+}
+
 VOID Instruction(INS ins, void * v)
 {
     UINT32 memOperands = INS_MemoryOperandCount(ins);
@@ -105,9 +111,25 @@ VOID Instruction(INS ins, void * v)
                                      IARG_MEMORYOP_EA, memOp, IARG_END);
         }
     }
+}
 
-    // Count each and every instruction
-    INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)count_instruction, IARG_END);
+VOID Trace(TRACE trace, VOID *v)
+{
+    // Count the instructions of every basic block with a single call at its
+    // head. REP instructions run their analysis calls once per iteration, so
+    // they keep their own call to count the same way as before.
+    for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+        UINT32 num_ins = 0;
+        for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+            if (INS_HasRealRep(ins))
+                INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)count_instruction, IARG_END);
+            else
+                num_ins++;
+        }
+        if (num_ins > 0)
+            BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR)count_bbl_instructions,
+                           IARG_FAST_ANALYSIS_CALL, IARG_UINT32, num_ins, IARG_END);
+    }
 }
 
 /* ===================================================================== */
@@ -132,6 +154,7 @@ VOID Fini(int code, VOID * v)
 VOID roi_begin()
 {
     INS_AddInstrumentFunction(Instruction, 0);
+    TRACE_AddInstrumentFunction(Trace, 0);
 }
 
 
@@ -159,6 +182,7 @@ int main(int argc, char *argv[])
 				  //KnobL2PrefetchLines.Value()); (I don't want prefetching at all in this run, so hardcode 0)
 
     INS_AddInstrumentFunction(Instruction, 0);
+    TRACE_AddInstrumentFunction(Trace, 0);
 
     // Called when the instrumented application finishes its execution
     PIN_AddFiniFunction(Fini, 0);